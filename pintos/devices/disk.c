@@ -6,10 +6,28 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers use bus-master DMA when the controller is a PCI IDE
+   controller with bus-master support, such as the PIIX that QEMU
+   emulates, and the buffer can be reached by DMA.  Otherwise they
+   fall back to PIO, which makes the CPU copy every word and
+   interrupts once per sector.
+
+   Transfers are queued per channel as struct disk_request.  The
+   channel runs one command at a time; when it completes, the
+   interrupt handler finishes its requests and starts the next
+   command itself, so a caller that submits a request may go on
+   with other work and wait for it later, or never.  The next
+   command is chosen by C-LOOK: the pending request at or after the
+   end of the last command, in (device, sector) order, or else the
+   lowest one.  Pending requests that continue it on the same disk
+   in the same direction are merged into the same command. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)   /* Data. */
@@ -28,10 +46,26 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206) /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl(CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus-master IDE port addresses, relative to the channel's
+   bus-master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table address. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
+#define STA_DF 0x20   /* Device Fault. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start transfer. */
+#define BM_CMD_READ 0x08  /* 1=device to memory, 0=memory to device. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ERR 0x02  /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04 /* Device interrupted (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -47,6 +81,26 @@
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8           /* READ DMA. */
+#define CMD_WRITE_DMA 0xca          /* WRITE DMA. */
+
+/* PCI configuration space, just enough of it to find the
+   bus-master registers of the IDE controller. */
+#define PCI_CONFIG_ADDR 0xcf8     /* Configuration address port. */
+#define PCI_CONFIG_DATA 0xcfc     /* Configuration data port. */
+#define PCI_REG_COMMAND 0x04      /* Command (low half) and status. */
+#define PCI_REG_CLASS 0x08        /* Class, subclass, interface, revision. */
+#define PCI_REG_BAR4 0x20         /* Base address 4: bus-master registers. */
+#define PCI_CMD_BUS_MASTER 0x0004 /* Device may act as a bus master. */
+
+/* A physical region descriptor: one physically contiguous piece of
+   a DMA buffer.  A region may not cross a 64 kB boundary. */
+struct prd {
+    uint32_t addr;  /* Physical address. */
+    uint16_t size;  /* Size in bytes, 0 for 64 kB. */
+    uint16_t flags; /* PRD_EOT in the last descriptor. */
+};
+#define PRD_EOT 0x8000 /* End of table. */
 
 /* An ATA device. */
 struct disk {
@@ -56,9 +110,12 @@ struct disk {
 
     bool is_ata;            /* 1=This device is an ATA disk. */
     disk_sector_t capacity; /* Capacity in sectors (if is_ata). */
+    bool dma;               /* 1=Device supports DMA (if is_ata). */
 
     long long read_cnt;  /* Number of sectors read. */
     long long write_cnt; /* Number of sectors written. */
+    long long cmd_cnt;   /* Number of read/write commands issued. */
+    long long dma_cnt;   /* Number of those that used DMA. */
 };
 
 /* An ATA channel (aka controller).
@@ -66,12 +123,24 @@ struct disk {
 struct channel {
     char name[8];      /* Name, e.g. "hd0". */
     uint16_t reg_base; /* Base I/O port. */
+    uint16_t bm_base;  /* Bus-master I/O port, 0 if none. */
+    struct prd* prdt;  /* PRD table, if bm_base is nonzero. */
     uint8_t irq;       /* Interrupt in use. */
 
-    struct lock lock;                 /* Must acquire to access the controller. */
     bool expecting_interrupt;         /* True if an interrupt is expected, false if
                                          any interrupt would be spurious. */
-    struct semaphore completion_wait; /* Up'd by interrupt handler. */
+    struct semaphore completion_wait; /* Up'd by interrupt handler, while
+                                         no command is queued. */
+
+    /* Request queue.  Accessed with interrupts off. */
+    struct list queue;          /* Pending requests, in arrival order. */
+    struct list active;         /* Requests in the command in progress. */
+    bool active_dma;            /* Command in progress uses DMA. */
+    bool active_write;          /* Command in progress writes. */
+    struct list_elem* pio_req;  /* PIO: request being transferred. */
+    size_t pio_sec;             /* PIO: its sectors already transferred. */
+    struct disk* head_disk;     /* Disk of the last command, for C-LOOK. */
+    disk_sector_t head_sec;     /* Sector just past the last command. */
 
     struct disk devices[2]; /* The devices on this channel. */
 };
@@ -84,13 +153,23 @@ static void reset_channel(struct channel*);
 static bool check_device_type(struct disk*);
 static void identify_ata_device(struct disk*);
 
-static void select_sector(struct disk*, disk_sector_t);
+static void select_sector(struct disk*, disk_sector_t, size_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
 
+static uint16_t find_bus_master(void);
+static bool dma_usable(const struct disk*, const void*, size_t cnt);
+static void dma_start(struct channel*, disk_sector_t, size_t cnt);
+static void dma_finish(struct channel*, uint8_t status);
+
+static void dispatch(struct channel*);
+static void command_interrupt(struct channel*, uint8_t status);
+
+static void delay_400ns(struct channel*);
 static void wait_until_idle(const struct disk*);
 static bool wait_while_busy(const struct disk*);
+static uint8_t wait_for_drq(struct channel*);
 static void select_device(const struct disk*);
 static void select_device_wait(const struct disk*);
 
@@ -99,6 +178,7 @@ static void interrupt_handler(struct intr_frame*);
 /* Initialize the disk subsystem and detect disks. */
 void disk_init(void)
 {
+    uint16_t bm_base = find_bus_master();
     size_t chan_no;
 
     for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -119,9 +199,14 @@ void disk_init(void)
         default:
             NOT_REACHED();
         }
-        lock_init(&c->lock);
+        c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+        c->prdt = c->bm_base != 0 ? palloc_get_page(PAL_ASSERT) : NULL;
         c->expecting_interrupt = false;
         sema_init(&c->completion_wait, 0);
+        list_init(&c->queue);
+        list_init(&c->active);
+        c->head_disk = NULL;
+        c->head_sec = 0;
 
         /* Initialize devices. */
         for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,8 +217,10 @@ void disk_init(void)
 
             d->is_ata = false;
             d->capacity = 0;
+            d->dma = false;
 
             d->read_cnt = d->write_cnt = 0;
+            d->cmd_cnt = d->dma_cnt = 0;
         }
 
         /* Register interrupt handler. */
@@ -167,7 +254,8 @@ void disk_print_stats(void)
         for (dev_no = 0; dev_no < 2; dev_no++) {
             struct disk* d = disk_get(chan_no, dev_no);
             if (d != NULL && d->is_ata)
-                printf("%s: %lld reads, %lld writes\n", d->name, d->read_cnt, d->write_cnt);
+                printf("%s: %lld reads, %lld writes, %lld commands (%lld DMA)\n", d->name, d->read_cnt,
+                       d->write_cnt, d->cmd_cnt, d->dma_cnt);
         }
     }
 }
@@ -208,21 +296,7 @@ disk_sector_t disk_size(struct disk* d)
    per-disk locking is unneeded. */
 void disk_read(struct disk* d, disk_sector_t sec_no, void* buffer)
 {
-    struct channel* c;
-
-    ASSERT(d != NULL);
-    ASSERT(buffer != NULL);
-
-    c = d->channel;
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-    sema_down(&c->completion_wait);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-    input_sector(c, buffer);
-    d->read_cnt++;
-    lock_release(&c->lock);
+    disk_read_multi(d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -232,21 +306,269 @@ void disk_read(struct disk* d, disk_sector_t sec_no, void* buffer)
    per-disk locking is unneeded. */
 void disk_write(struct disk* d, disk_sector_t sec_no, const void* buffer)
 {
-    struct channel* c;
+    disk_write_multi(d, sec_no, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes, and waits for them.  The whole run is transferred by a
+   single READ DMA or READ SECTOR command, possibly together with
+   neighbouring requests.  CNT must be between 1 and
+   DISK_MAX_SECTORS. */
+void disk_read_multi(struct disk* d, disk_sector_t sec_no, size_t cnt, void* buffer)
+{
+    struct disk_request r;
 
+    disk_request_init(&r, d, sec_no, cnt, buffer, false, NULL, NULL);
+    disk_submit(&r);
+    disk_wait(&r);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes,
+   using a single WRITE DMA or WRITE SECTOR command.  Returns after
+   the disk has acknowledged receiving all of the data.  CNT must
+   be between 1 and DISK_MAX_SECTORS. */
+void disk_write_multi(struct disk* d, disk_sector_t sec_no, size_t cnt, const void* buffer)
+{
+    struct disk_request r;
+
+    disk_request_init(&r, d, sec_no, cnt, (void*)buffer, true, NULL, NULL);
+    disk_submit(&r);
+    disk_wait(&r);
+}
+
+/* Initializes R to transfer CNT consecutive sectors starting at
+   SEC_NO between disk D and BUFFER, into BUFFER unless WRITE.
+   BUFFER must be a kernel address, because the transfer may
+   happen while another process is running, and must stay valid
+   until the request completes.  CNT must be between 1 and
+   DISK_MAX_SECTORS.
+
+   If DONE is non-null, it is called with R when R completes, from
+   the disk interrupt handler, so it must not sleep; R belongs to
+   DONE from then on and must not be passed to disk_wait().
+   Otherwise completion is awaited with disk_wait(). */
+void disk_request_init(struct disk_request* r, struct disk* d, disk_sector_t sec_no, size_t cnt, void* buffer,
+                       bool write, disk_done_func* done, void* aux)
+{
     ASSERT(d != NULL);
-    ASSERT(buffer != NULL);
-
-    c = d->channel;
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-    output_sector(c, buffer);
-    sema_down(&c->completion_wait);
-    d->write_cnt++;
-    lock_release(&c->lock);
+    ASSERT(buffer != NULL && is_kernel_vaddr(buffer));
+    ASSERT(cnt > 0 && cnt <= DISK_MAX_SECTORS);
+
+    r->disk = d;
+    r->sec_no = sec_no;
+    r->cnt = cnt;
+    r->buffer = buffer;
+    r->write = write;
+    r->done = done;
+    r->aux = aux;
+    sema_init(&r->complete, 0);
+}
+
+/* Queues R, initialized with disk_request_init(), and returns
+   without waiting for it. */
+void disk_submit(struct disk_request* r)
+{
+    struct channel* c = r->disk->channel;
+    enum intr_level old_level;
+
+    ASSERT(r->sec_no + r->cnt <= r->disk->capacity);
+
+    old_level = intr_disable();
+    list_push_back(&c->queue, &r->elem);
+    if (list_empty(&c->active))
+        dispatch(c);
+    intr_set_level(old_level);
+}
+
+/* Waits for R, which was submitted without a completion function,
+   to complete. */
+void disk_wait(struct disk_request* r)
+{
+    ASSERT(r->done == NULL);
+    sema_down(&r->complete);
+}
+
+/* Request scheduling. */
+
+/* Returns true if requests A and B are on the same disk and
+   cover a common sector. */
+static bool requests_overlap(const struct disk_request* a, const struct disk_request* b)
+{
+    return a->disk == b->disk && a->sec_no < b->sec_no + b->cnt && b->sec_no < a->sec_no + a->cnt;
+}
+
+/* Returns true if request R in C's queue may be started: no
+   request queued before it touches the same sectors, so that, for
+   example, a read never passes the write it has to see. */
+static bool request_ready(struct channel* c, struct disk_request* r)
+{
+    struct list_elem* e;
+
+    for (e = list_begin(&c->queue); e != &r->elem; e = list_next(e))
+        if (requests_overlap(list_entry(e, struct disk_request, elem), r))
+            return false;
+    return true;
+}
+
+/* Returns R's position in C-LOOK order, (device, sector). */
+static uint64_t request_key(const struct disk_request* r)
+{
+    return ((uint64_t)r->disk->dev_no << 32) | r->sec_no;
+}
+
+/* Chooses the request to start the next command on C with, by
+   C-LOOK.  C's queue must not be empty. */
+static struct disk_request* clook_next(struct channel* c)
+{
+    uint64_t head = c->head_disk != NULL ? ((uint64_t)c->head_disk->dev_no << 32) | c->head_sec : 0;
+    struct disk_request *ahead = NULL, *lowest = NULL;
+    struct list_elem* e;
+
+    for (e = list_begin(&c->queue); e != list_end(&c->queue); e = list_next(e)) {
+        struct disk_request* r = list_entry(e, struct disk_request, elem);
+        if (!request_ready(c, r))
+            continue;
+        if (request_key(r) >= head && (ahead == NULL || request_key(r) < request_key(ahead)))
+            ahead = r;
+        if (lowest == NULL || request_key(r) < request_key(lowest))
+            lowest = r;
+    }
+    /* The first queued request is always ready. */
+    return ahead != NULL ? ahead : lowest;
+}
+
+/* Returns a ready request in C's queue that continues the run of
+   CNT sectors at SEC_NO on disk D in the same direction and
+   transfer mode, without making the run longer than
+   DISK_MAX_SECTORS, or a null pointer. */
+static struct disk_request* find_merge(struct channel* c, struct disk* d, disk_sector_t sec_no, size_t cnt, bool write,
+                                       bool dma)
+{
+    struct list_elem* e;
+
+    for (e = list_begin(&c->queue); e != list_end(&c->queue); e = list_next(e)) {
+        struct disk_request* r = list_entry(e, struct disk_request, elem);
+        if (r->disk == d && r->write == write && r->sec_no == sec_no + cnt && cnt + r->cnt <= DISK_MAX_SECTORS &&
+            dma_usable(d, r->buffer, r->cnt) == dma && request_ready(c, r))
+            return r;
+    }
+    return NULL;
+}
+
+/* Starts the next command on channel C, if any request is
+   pending.  C must be idle.  Called with interrupts off, from
+   disk_submit() or from the interrupt handler. */
+static void dispatch(struct channel* c)
+{
+    struct disk_request *first, *r;
+    struct disk* d;
+    size_t cnt;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(list_empty(&c->active));
+
+    if (list_empty(&c->queue))
+        return;
+
+    first = clook_next(c);
+    d = first->disk;
+    cnt = first->cnt;
+    c->active_write = first->write;
+    c->active_dma = dma_usable(d, first->buffer, first->cnt);
+    list_remove(&first->elem);
+    list_push_back(&c->active, &first->elem);
+    while ((r = find_merge(c, d, first->sec_no, cnt, c->active_write, c->active_dma)) != NULL) {
+        list_remove(&r->elem);
+        list_push_back(&c->active, &r->elem);
+        cnt += r->cnt;
+    }
+
+    c->head_disk = d;
+    c->head_sec = first->sec_no + cnt;
+    if (c->active_write)
+        d->write_cnt += cnt;
+    else
+        d->read_cnt += cnt;
+    d->cmd_cnt++;
+
+    if (c->active_dma) {
+        d->dma_cnt++;
+        dma_start(c, first->sec_no, cnt);
+        return;
+    }
+
+    c->pio_req = list_begin(&c->active);
+    c->pio_sec = 0;
+    select_sector(d, first->sec_no, cnt);
+    issue_pio_command(c, c->active_write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY);
+    /* A write hands over its first sector as soon as the device
+       asks for it; every later one follows an interrupt. */
+    if (c->active_write) {
+        if (!(wait_for_drq(c) & STA_DRQ))
+            PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, first->sec_no);
+        output_sector(c, first->buffer);
+    }
+}
+
+/* Completes the requests of the command on C that has just
+   finished.  The next command is started before any completion
+   function runs, so that the disk is kept busy meanwhile and the
+   functions may submit new requests. */
+static void finish_active(struct channel* c)
+{
+    struct list done;
+
+    list_init(&done);
+    while (!list_empty(&c->active))
+        list_push_back(&done, list_pop_front(&c->active));
+    dispatch(c);
+
+    while (!list_empty(&done)) {
+        struct disk_request* r = list_entry(list_pop_front(&done), struct disk_request, elem);
+        if (r->done != NULL)
+            r->done(r);
+        else
+            sema_up(&r->complete);
+    }
+}
+
+/* Handles the interrupt that the device on C raised for the
+   command in progress, whose status register read STATUS: moves
+   the next PIO sector or finishes the command, and then starts the
+   next one. */
+static void command_interrupt(struct channel* c, uint8_t status)
+{
+    if (c->active_dma)
+        dma_finish(c, status);
+    else {
+        struct disk_request* r = list_entry(c->pio_req, struct disk_request, elem);
+
+        if ((status & (STA_ERR | STA_DF)) || (!c->active_write && !(status & STA_DRQ)))
+            PANIC("%s: disk %s failed, sector=%" PRDSNu, r->disk->name, c->active_write ? "write" : "read",
+                  r->sec_no + (disk_sector_t)c->pio_sec);
+
+        /* A read interrupt brings a sector; a write interrupt
+           acknowledges one. */
+        if (!c->active_write)
+            input_sector(c, (uint8_t*)r->buffer + c->pio_sec * DISK_SECTOR_SIZE);
+        if (++c->pio_sec == r->cnt) {
+            c->pio_req = list_next(c->pio_req);
+            c->pio_sec = 0;
+        }
+        if (c->pio_req != list_end(&c->active)) {
+            if (c->active_write) {
+                r = list_entry(c->pio_req, struct disk_request, elem);
+                if (!(wait_for_drq(c) & STA_DRQ))
+                    PANIC("%s: disk write failed, sector=%" PRDSNu, r->disk->name,
+                          r->sec_no + (disk_sector_t)c->pio_sec);
+                output_sector(c, (uint8_t*)r->buffer + c->pio_sec * DISK_SECTOR_SIZE);
+            }
+            return;
+        }
+    }
+    finish_active(c);
 }
 
 /* Disk detection and identification. */
@@ -360,6 +682,9 @@ static void identify_ata_device(struct disk* d)
     /* Calculate capacity. */
     d->capacity = id[60] | ((uint32_t)id[61] << 16);
 
+    /* Word 49, bit 8: DMA supported. */
+    d->dma = (id[49] & 0x0100) != 0;
+
     /* Print identification message. */
     printf("%s: detected %'" PRDSNu " sector (", d->name, d->capacity);
     if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -397,17 +722,18 @@ static void print_ata_string(char* string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector(struct disk* d, disk_sector_t sec_no)
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.)  A count of 256 is
+   encoded as 0. */
+static void select_sector(struct disk* d, disk_sector_t sec_no, size_t cnt)
 {
     struct channel* c = d->channel;
 
-    ASSERT(sec_no < d->capacity);
-    ASSERT(sec_no < (1UL << 28));
+    ASSERT(sec_no + cnt <= d->capacity);
+    ASSERT(sec_no + cnt <= (1UL << 28));
 
     select_device_wait(d);
-    outb(reg_nsect(c), 1);
+    outb(reg_nsect(c), (uint8_t)cnt);
     outb(reg_lbal(c), sec_no);
     outb(reg_lbam(c), sec_no >> 8);
     outb(reg_lbah(c), (sec_no >> 16));
@@ -418,10 +744,6 @@ static void select_sector(struct disk* d, disk_sector_t sec_no)
    completion interrupt. */
 static void issue_pio_command(struct channel* c, uint8_t command)
 {
-    /* Interrupts must be enabled or our semaphore will never be
-       up'd by the completion handler. */
-    ASSERT(intr_get_level() == INTR_ON);
-
     c->expecting_interrupt = true;
     outb(reg_command(c), command);
 }
@@ -440,22 +762,153 @@ static void output_sector(struct channel* c, const void* sector)
     outsw(reg_data(c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Bus-master DMA. */
+
+/* Reads register REG of PCI function FUNC of device DEV on bus
+   BUS. */
+static uint32_t pci_read_config(int bus, int dev, int func, int reg)
+{
+    outl(PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/* Writes DATA to register REG of PCI function FUNC of device DEV
+   on bus BUS. */
+static void pci_write_config(int bus, int dev, int func, int reg, uint32_t data)
+{
+    outl(PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+    outl(PCI_CONFIG_DATA, data);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus-master
+   DMA, such as the PIIX in a PC, and enables bus mastering on it.
+   Returns the I/O port of its bus-master registers for the primary
+   channel, which the firmware has assigned; those of the secondary
+   channel follow 8 ports later.  Returns 0 if there is none. */
+static uint16_t find_bus_master(void)
+{
+    for (int dev = 0; dev < 32; dev++)
+        for (int func = 0; func < 8; func++) {
+            uint32_t class = pci_read_config(0, dev, func, PCI_REG_CLASS);
+            uint32_t bar4, command;
+
+            if (func == 0 && pci_read_config(0, dev, 0, 0) == 0xffffffff)
+                break;
+            /* Mass storage, IDE, bus-master capable. */
+            if ((class >> 16) != 0x0101 || !(class & 0x8000))
+                continue;
+            bar4 = pci_read_config(0, dev, func, PCI_REG_BAR4);
+            if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+                continue;
+            command = pci_read_config(0, dev, func, PCI_REG_COMMAND);
+            pci_write_config(0, dev, func, PCI_REG_COMMAND, (command & 0xffff) | PCI_CMD_BUS_MASTER);
+            return bar4 & 0xfffc;
+        }
+    return 0;
+}
+
+/* Returns true if CNT sectors can be moved between disk D and
+   BUFFER by DMA.  The controller takes 32-bit physical addresses
+   of even bytes, so BUFFER must be in the kernel's direct map,
+   below 4 GB, and 2-byte aligned. */
+static bool dma_usable(const struct disk* d, const void* buffer, size_t cnt)
+{
+    if (d->channel->bm_base == 0 || !d->dma || !is_kernel_vaddr(buffer) || ((uintptr_t)buffer & 1) != 0)
+        return false;
+    return vtop(buffer) + cnt * DISK_SECTOR_SIZE <= 0x100000000ULL;
+}
+
+/* Fills in PRD table entries starting at PRD to describe the SIZE
+   bytes at BUFFER, which dma_usable() has approved, and returns
+   the entry following them. */
+static struct prd* build_prdt(struct prd* prd, const void* buffer, size_t size)
+{
+    uint64_t pa = vtop(buffer);
+
+    while (size > 0) {
+        size_t chunk = 0x10000 - (pa & 0xffff);
+        if (chunk > size)
+            chunk = size;
+        prd->addr = pa;
+        prd->size = chunk & 0xffff;
+        prd->flags = 0;
+        prd++;
+        pa += chunk;
+        size -= chunk;
+    }
+    return prd;
+}
+
+/* Starts the command in progress on channel C, the run of CNT
+   sectors at SEC_NO made of C's active requests, as a single READ
+   DMA or WRITE DMA command.  The device interrupts once, when the
+   whole run is done. */
+static void dma_start(struct channel* c, disk_sector_t sec_no, size_t cnt)
+{
+    struct disk_request* first = list_entry(list_front(&c->active), struct disk_request, elem);
+    uint8_t dir = c->active_write ? 0 : BM_CMD_READ;
+    struct prd* prd = c->prdt;
+    struct list_elem* e;
+
+    for (e = list_begin(&c->active); e != list_end(&c->active); e = list_next(e)) {
+        struct disk_request* r = list_entry(e, struct disk_request, elem);
+        prd = build_prdt(prd, r->buffer, r->cnt * DISK_SECTOR_SIZE);
+    }
+    prd[-1].flags = PRD_EOT;
+
+    outl(reg_bm_prdt(c), vtop(c->prdt));
+    outb(reg_bm_command(c), dir);
+    outb(reg_bm_status(c), inb(reg_bm_status(c)) | BM_STA_ERR | BM_STA_INTR);
+
+    select_sector(first->disk, sec_no, cnt);
+    issue_pio_command(c, c->active_write ? CMD_WRITE_DMA : CMD_READ_DMA);
+    outb(reg_bm_command(c), dir | BM_CMD_START);
+}
+
+/* Stops the DMA engine of channel C after the completion interrupt
+   of its command, whose status register read STATUS, and checks
+   that the transfer succeeded. */
+static void dma_finish(struct channel* c, uint8_t status)
+{
+    struct disk_request* first = list_entry(list_front(&c->active), struct disk_request, elem);
+    uint8_t bm_status;
+
+    outb(reg_bm_command(c), c->active_write ? 0 : BM_CMD_READ);
+    bm_status = inb(reg_bm_status(c));
+    outb(reg_bm_status(c), bm_status | BM_STA_ERR | BM_STA_INTR);
+    if ((bm_status & BM_STA_ERR) || (status & (STA_ERR | STA_DF)))
+        PANIC("%s: disk %s failed, sector=%" PRDSNu, first->disk->name, c->active_write ? "write" : "read",
+              first->sec_no);
+}
+
 /* Low-level ATA primitives. */
 
+/* Busy-waits at least 400 ns, the time the ATA standard gives a
+   device to settle after it is selected, by reading the alternate
+   status register, each read of which takes at least 100 ns.
+   Usable with interrupts off. */
+static void delay_400ns(struct channel* c)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        inb(reg_alt_status(c));
+}
+
 /* Wait up to 10 seconds for the controller to become idle, that
    is, for the BSY and DRQ bits to clear in the status register.
+   Polls without sleeping, so it is usable with interrupts off.
 
    As a side effect, reading the status register clears any
    pending interrupt. */
 static void wait_until_idle(const struct disk* d)
 {
-    int i;
+    long i;
 
-    for (i = 0; i < 1000; i++) {
+    /* 상태 레지스터를 한 번 읽는 데 100 ns 이상 걸림 */
+    for (i = 0; i < 100L * 1000 * 1000; i++)
         if ((inb(reg_status(d->channel)) & (STA_BSY | STA_DRQ)) == 0)
             return;
-        timer_usleep(10);
-    }
 
     printf("%s: idle timeout\n", d->name);
 }
@@ -484,6 +937,22 @@ static bool wait_while_busy(const struct disk* d)
     return false;
 }
 
+/* Waits up to a second, without sleeping, for channel C to clear
+   BSY, and returns its status, in which the caller checks DRQ.
+   Usable with interrupts off. */
+static uint8_t wait_for_drq(struct channel* c)
+{
+    uint8_t status;
+    long i;
+
+    for (i = 0; i < 10L * 1000 * 1000; i++) {
+        status = inb(reg_alt_status(c));
+        if (!(status & STA_BSY))
+            return status;
+    }
+    return status;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void select_device(const struct disk* d)
 {
@@ -492,8 +961,7 @@ static void select_device(const struct disk* d)
     if (d->dev_no == 1)
         dev |= DEV_DEV;
     outb(reg_device(c), dev);
-    inb(reg_alt_status(c));
-    timer_nsleep(400);
+    delay_400ns(c);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -513,8 +981,11 @@ static void interrupt_handler(struct intr_frame* f)
     for (c = channels; c < channels + CHANNEL_CNT; c++)
         if (f->vec_no == c->irq) {
             if (c->expecting_interrupt) {
-                inb(reg_status(c));           /* Acknowledge interrupt. */
-                sema_up(&c->completion_wait); /* Wake up waiter. */
+                uint8_t status = inb(reg_status(c)); /* Acknowledge interrupt. */
+                if (!list_empty(&c->active))
+                    command_interrupt(c, status);
+                else
+                    sema_up(&c->completion_wait); /* Wake up waiter. */
             } else
                 printf("%s: unexpected interrupt\n", c->name);
             return;
@@ -17,14 +17,28 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Written only by the
+   timer interrupt, under TICKS_SEQ. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Armed timer events, kept in a pairing heap ordered by expiry.
+   NEXT_EXPIRY caches the root's expiry, so a tick on which nothing
+   expires costs a single comparison.  Protected by disabling
+   interrupts. */
+static struct timer_event* timer_heap;
+static int64_t next_expiry = INT64_MAX;
+static uint64_t timer_seq; /* Breaks ties between equal expiries. */
+
 static intr_handler_func timer_interrupt;
+static void timer_expire(void);
+static struct timer_event* heap_meld(struct timer_event*, struct timer_event*);
+static struct timer_event* heap_merge_pairs(struct timer_event*);
+static void heap_remove(struct timer_event*);
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
@@ -38,6 +52,8 @@ void timer_init(void)
        nearest. */
     uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
 
+    seqlock_init(&ticks_seq);
+
     outb(0x43, 0x34); /* CW: counter 0, LSB then MSB, mode 2, binary. */
     outb(0x40, count & 0xff);
     outb(0x40, count >> 8);
@@ -73,9 +89,13 @@ void timer_calibrate(void)
 /* Returns the number of timer ticks since the OS booted. */
 int64_t timer_ticks(void)
 {
-    enum intr_level old_level = intr_disable();
-    int64_t t = ticks;
-    intr_set_level(old_level);
+    unsigned seq;
+    int64_t t;
+
+    do {
+        seq = seqlock_read_begin(&ticks_seq);
+        t = ticks;
+    } while (seqlock_read_retry(&ticks_seq, seq));
     barrier();
     return t;
 }
@@ -116,6 +136,61 @@ void timer_nsleep(int64_t ns)
     real_time_sleep(ns, 1000 * 1000 * 1000);
 }
 
+/* Initializes timer event E to call FUNC with AUX when it expires.
+   E starts out disarmed. */
+void timer_event_init(struct timer_event* e, timer_callback* func, void* aux)
+{
+    ASSERT(e != NULL);
+    ASSERT(func != NULL);
+
+    e->expires = 0;
+    e->func = func;
+    e->aux = aux;
+    e->armed = false;
+    e->child = e->sibling = e->prev = NULL;
+}
+
+/* Arms E to fire at timer tick TICK, re-arming it if it is already
+   armed.  A tick that has already passed fires on the next timer
+   interrupt.  Events with the same tick fire in the order they
+   were armed.
+
+   The callback runs in the timer interrupt handler with
+   interrupts off, so it must not sleep.  May be called from an
+   interrupt handler, including from a timer callback. */
+void timer_arm(struct timer_event* e, int64_t tick)
+{
+    enum intr_level old_level = intr_disable();
+
+    if (e->armed)
+        heap_remove(e);
+    e->expires = tick;
+    e->seq = timer_seq++;
+    e->armed = true;
+    e->child = e->sibling = e->prev = NULL;
+    timer_heap = heap_meld(timer_heap, e);
+    next_expiry = timer_heap->expires;
+
+    intr_set_level(old_level);
+}
+
+/* Disarms E.  Returns true if E was armed, false if it had
+   already fired or was never armed. */
+bool timer_cancel(struct timer_event* e)
+{
+    enum intr_level old_level = intr_disable();
+    bool was_armed = e->armed;
+
+    if (was_armed) {
+        heap_remove(e);
+        e->armed = false;
+        next_expiry = timer_heap != NULL ? timer_heap->expires : INT64_MAX;
+    }
+
+    intr_set_level(old_level);
+    return was_armed;
+}
+
 /* Prints timer statistics. */
 void timer_print_stats(void)
 {
@@ -125,7 +200,9 @@ void timer_print_stats(void)
 /* Timer interrupt handler. */
 static void timer_interrupt(struct intr_frame* args UNUSED)
 {
+    seqlock_write_begin(&ticks_seq);
     ticks++;
+    seqlock_write_end(&ticks_seq);
     thread_tick();
     // project 1-4 advanced
     if (thread_mlfqs) {
@@ -138,7 +215,105 @@ static void timer_interrupt(struct intr_frame* args UNUSED)
             update_recent_cpu();
         }
     }
-    thread_awake(ticks);
+    if (ticks >= next_expiry)
+        timer_expire();
+}
+
+/* Fires every timer event that is due.  A callback may re-arm its
+   own event or arm others. */
+static void timer_expire(void)
+{
+    while (timer_heap != NULL && timer_heap->expires <= ticks) {
+        struct timer_event* e = timer_heap;
+
+        heap_remove(e);
+        e->armed = false;
+        next_expiry = timer_heap != NULL ? timer_heap->expires : INT64_MAX;
+        e->func(e->aux);
+    }
+}
+
+/* Returns true if A should fire before B. */
+static bool event_before(const struct timer_event* a, const struct timer_event* b)
+{
+    return a->expires < b->expires || (a->expires == b->expires && a->seq < b->seq);
+}
+
+/* Melds the heaps rooted at A and B, both of which must be
+   detached (no siblings, no parent), and returns the new root. */
+static struct timer_event* heap_meld(struct timer_event* a, struct timer_event* b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (event_before(b, a)) {
+        struct timer_event* tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    /* B becomes A's leftmost child.  A leftmost child's PREV points
+       to its parent; any other child's PREV points to its left
+       sibling. */
+    b->prev = a;
+    b->sibling = a->child;
+    if (a->child != NULL)
+        a->child->prev = b;
+    a->child = b;
+    return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single heap with
+   the usual two-pass pairing: left to right in pairs, then the
+   pairs right to left. */
+static struct timer_event* heap_merge_pairs(struct timer_event* first)
+{
+    struct timer_event* pairs = NULL;
+    struct timer_event* root = NULL;
+
+    while (first != NULL) {
+        struct timer_event* a = first;
+        struct timer_event* b = a->sibling;
+        struct timer_event* m;
+
+        first = b != NULL ? b->sibling : NULL;
+        a->sibling = a->prev = NULL;
+        if (b != NULL)
+            b->sibling = b->prev = NULL;
+        m = heap_meld(a, b);
+        m->sibling = pairs;
+        pairs = m;
+    }
+
+    while (pairs != NULL) {
+        struct timer_event* next = pairs->sibling;
+
+        pairs->sibling = NULL;
+        root = heap_meld(root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+/* Removes armed event E from the heap. */
+static void heap_remove(struct timer_event* e)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(e->armed);
+
+    if (e == timer_heap)
+        timer_heap = heap_merge_pairs(e->child);
+    else {
+        if (e->prev->child == e)
+            e->prev->child = e->sibling;
+        else
+            e->prev->sibling = e->sibling;
+        if (e->sibling != NULL)
+            e->sibling->prev = e->prev;
+        timer_heap = heap_meld(timer_heap, heap_merge_pairs(e->child));
+    }
+    e->child = e->sibling = e->prev = NULL;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
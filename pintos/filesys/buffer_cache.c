@@ -0,0 +1,334 @@
+/* buffer_cache.c: Sector cache shared by the whole file system.
+ *
+ * Every read and write of the file system disk goes through a fixed
+ * set of BUFFER_CACHE_SIZE cached sectors. Writes only dirty the cached
+ * copy; a flusher thread writes dirty sectors back every FLUSH_INTERVAL
+ * ticks, and filesys_done() flushes whatever is left. Sequential readers
+ * queue the next sector for a read-ahead thread so that it is usually
+ * cached by the time it is asked for. Entries are replaced with the
+ * clock algorithm.
+ *
+ * Write-behind and read-ahead submit all of their requests to the disk
+ * queue before waiting for any, so that the disk can sort them and
+ * merge neighbouring sectors into one command. They transfer through
+ * buffers of their own and hold no entry lock while the disk works, so
+ * they never wait for each other or for a reader. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define BUFFER_CACHE_SIZE 64            /* Number of cached sectors. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ) /* Ticks between write-behind passes. */
+#define READAHEAD_MAX 16                /* Pending read-ahead requests. */
+#define INVALID_SECTOR ((disk_sector_t)-1)
+
+/* A cached sector. */
+struct cache_entry {
+    /* Protected by cache_lock. */
+    disk_sector_t sector; /* Cached sector, or INVALID_SECTOR. */
+    int pin_cnt;          /* Users in flight. Pinned entries are not replaced. */
+    bool accessed;        /* Used since the clock hand last passed. */
+
+    /* Protected by LOCK. SECTOR only changes while LOCK is held too. */
+    struct lock lock;
+    bool valid; /* DATA holds the contents of SECTOR. */
+    bool dirty; /* DATA is newer than the disk. */
+    uint8_t data[DISK_SECTOR_SIZE];
+};
+
+static struct cache_entry cache[BUFFER_CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* An entry's pin count dropped to zero. */
+static size_t clock_hand;
+
+/* Read-ahead requests, a ring protected by cache_lock. */
+static disk_sector_t ra_queue[READAHEAD_MAX];
+static size_t ra_head, ra_tail;
+static struct semaphore ra_sema;
+
+/* Write-behind copies, protected by flush_lock. */
+static uint8_t flush_buf[BUFFER_CACHE_SIZE][DISK_SECTOR_SIZE];
+static struct disk_request flush_io[BUFFER_CACHE_SIZE];
+static struct lock flush_lock;
+
+static struct cache_entry* lookup(disk_sector_t sector);
+static struct cache_entry* pick_victim(void);
+static struct cache_entry* cache_get(disk_sector_t sector, bool load);
+static void cache_put(struct cache_entry* e);
+static void unpin(struct cache_entry* e);
+static void flusher(void* aux);
+static void read_ahead(void* aux);
+
+/* Initializes the buffer cache and starts its helper threads. */
+void buffer_cache_init(void)
+{
+    size_t i;
+
+    lock_init(&cache_lock);
+    cond_init(&cache_unpinned);
+    lock_init(&flush_lock);
+    for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+        struct cache_entry* e = &cache[i];
+        e->sector = INVALID_SECTOR;
+        e->pin_cnt = 0;
+        e->accessed = false;
+        lock_init(&e->lock);
+        e->valid = false;
+        e->dirty = false;
+    }
+    clock_hand = 0;
+    ra_head = ra_tail = 0;
+    sema_init(&ra_sema, 0);
+
+    thread_create("bc_flusher", PRI_DEFAULT, flusher, NULL);
+    thread_create("bc_readahead", PRI_DEFAULT, read_ahead, NULL);
+}
+
+/* Writes every dirty sector back to disk. */
+void buffer_cache_done(void)
+{
+    buffer_cache_flush();
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void buffer_cache_read(disk_sector_t sector, void* buffer, off_t ofs, size_t size)
+{
+    ASSERT(ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+    struct cache_entry* e = cache_get(sector, true);
+    memcpy(buffer, e->data + ofs, size);
+    cache_put(e);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR. A write
+ * of the whole sector does not read the old contents first. */
+void buffer_cache_write(disk_sector_t sector, const void* buffer, off_t ofs, size_t size)
+{
+    ASSERT(ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+    struct cache_entry* e = cache_get(sector, ofs != 0 || size != DISK_SECTOR_SIZE);
+    memcpy(e->data + ofs, buffer, size);
+    e->valid = true;
+    e->dirty = true;
+    cache_put(e);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache. The
+ * request is dropped if SECTOR is already cached or the queue is
+ * full. */
+void buffer_cache_readahead(disk_sector_t sector)
+{
+    lock_acquire(&cache_lock);
+    if (lookup(sector) == NULL && (ra_tail + 1) % READAHEAD_MAX != ra_head) {
+        ra_queue[ra_tail] = sector;
+        ra_tail = (ra_tail + 1) % READAHEAD_MAX;
+        sema_up(&ra_sema);
+    }
+    lock_release(&cache_lock);
+}
+
+/* Writes all dirty cached sectors back to disk. Every write is
+ * submitted before the first is waited for. */
+void buffer_cache_flush(void)
+{
+    size_t cnt = 0, i;
+
+    lock_acquire(&flush_lock);
+    /* entry lock은 복사하는 동안만 잡음. 사본을 쓰는 동안 entry가 다시 dirty 되거나
+     * 교체되어도, 같은 sector에 대한 이후 요청은 disk queue에서 이 쓰기를 앞지르지 않음 */
+    for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+        struct cache_entry* e = &cache[i];
+        lock_acquire(&e->lock);
+        if (e->dirty) {
+            memcpy(flush_buf[cnt], e->data, DISK_SECTOR_SIZE);
+            disk_request_init(&flush_io[cnt], filesys_disk, e->sector, 1, flush_buf[cnt], true, NULL, NULL);
+            disk_submit(&flush_io[cnt]);
+            e->dirty = false;
+            cnt++;
+        }
+        lock_release(&e->lock);
+    }
+    for (i = 0; i < cnt; i++)
+        disk_wait(&flush_io[i]);
+    lock_release(&flush_lock);
+}
+
+/* Returns the entry caching SECTOR, or a null pointer.
+ * Must be called with cache_lock held. */
+static struct cache_entry* lookup(disk_sector_t sector)
+{
+    size_t i;
+
+    ASSERT(lock_held_by_current_thread(&cache_lock));
+    for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+        if (cache[i].sector == sector)
+            return &cache[i];
+    return NULL;
+}
+
+/* Chooses an unpinned entry to replace with the clock algorithm, or
+ * returns a null pointer if every entry is pinned.
+ * Must be called with cache_lock held. */
+static struct cache_entry* pick_victim(void)
+{
+    size_t n;
+
+    ASSERT(lock_held_by_current_thread(&cache_lock));
+    for (n = 0; n < 2 * BUFFER_CACHE_SIZE; n++) {
+        struct cache_entry* e = &cache[clock_hand];
+        clock_hand = (clock_hand + 1) % BUFFER_CACHE_SIZE;
+
+        if (e->pin_cnt > 0)
+            continue;
+        if (e->sector != INVALID_SECTOR && e->accessed) {
+            e->accessed = false;
+            continue;
+        }
+        return e;
+    }
+    return NULL;
+}
+
+/* Returns the entry for SECTOR pinned and with its lock held. If LOAD
+ * is true its data is valid; otherwise the caller overwrites the whole
+ * sector. Release it with cache_put(). */
+static struct cache_entry* cache_get(disk_sector_t sector, bool load)
+{
+    struct cache_entry* e;
+
+    ASSERT(sector != INVALID_SECTOR);
+    for (;;) {
+        lock_acquire(&cache_lock);
+        e = lookup(sector);
+        if (e != NULL) {
+            /* Hit. Pinning keeps E from being relabelled while we wait
+             * for its lock. */
+            e->pin_cnt++;
+            e->accessed = true;
+            lock_release(&cache_lock);
+            lock_acquire(&e->lock);
+            break;
+        }
+
+        e = pick_victim();
+        if (e == NULL) {
+            /* 모든 entry가 pin됨: cache_put()이 하나를 풀 때까지 잠들었다가 다시 찾음 */
+            cond_wait(&cache_unpinned, &cache_lock);
+            lock_release(&cache_lock);
+            continue;
+        }
+        e->pin_cnt++;
+        lock_release(&cache_lock);
+
+        /* Write the old contents back before the entry changes hands. */
+        lock_acquire(&e->lock);
+        if (e->dirty) {
+            disk_write(filesys_disk, e->sector, e->data);
+            e->dirty = false;
+        }
+
+        lock_acquire(&cache_lock);
+        if (e->pin_cnt > 1 || lookup(sector) != NULL) {
+            /* Someone still wants the old sector, or another thread
+             * cached SECTOR meanwhile. Leave E alone and retry. */
+            unpin(e);
+            lock_release(&cache_lock);
+            lock_release(&e->lock);
+            continue;
+        }
+        e->sector = sector;
+        e->accessed = true;
+        e->valid = false;
+        lock_release(&cache_lock);
+        break;
+    }
+
+    if (load && !e->valid) {
+        disk_read(filesys_disk, sector, e->data);
+        e->valid = true;
+    }
+    return e;
+}
+
+/* Releases an entry obtained with cache_get(). */
+static void cache_put(struct cache_entry* e)
+{
+    lock_release(&e->lock);
+    lock_acquire(&cache_lock);
+    unpin(e);
+    lock_release(&cache_lock);
+}
+
+/* Drops a pin of E, waking the threads that wait for a replaceable
+ * entry if it was the last. Must be called with cache_lock held. */
+static void unpin(struct cache_entry* e)
+{
+    ASSERT(e->pin_cnt > 0);
+    if (--e->pin_cnt == 0)
+        cond_broadcast(&cache_unpinned, &cache_lock);
+}
+
+/* Write-behind thread. */
+static void flusher(void* aux UNUSED)
+{
+    for (;;) {
+        timer_sleep(FLUSH_INTERVAL);
+        buffer_cache_flush();
+    }
+}
+
+/* Read-ahead thread. Takes every queued request at once, submits
+ * the reads of those not yet cached, and then waits for them. Each
+ * entry is claimed for its sector and stays pinned, but unlocked, while
+ * the read is in flight; a reader that gets there first loads it
+ * itself, and the read-ahead copy is then dropped. */
+static void read_ahead(void* aux UNUSED)
+{
+    static uint8_t ra_buf[READAHEAD_MAX][DISK_SECTOR_SIZE];
+    static struct disk_request ra_io[READAHEAD_MAX];
+    struct cache_entry* batch[READAHEAD_MAX];
+
+    for (;;) {
+        size_t cnt = 0, i;
+
+        sema_down(&ra_sema);
+        do {
+            struct cache_entry* e;
+            disk_sector_t sector;
+
+            lock_acquire(&cache_lock);
+            sector = ra_queue[ra_head];
+            ra_head = (ra_head + 1) % READAHEAD_MAX;
+            lock_release(&cache_lock);
+
+            e = cache_get(sector, false);
+            if (e->valid) {
+                cache_put(e);
+                continue;
+            }
+            /* pin은 유지한 채 lock만 놓음: 다음 cache_get()이 다른 스레드가 쥔
+             * entry를 기다리는 동안 이 entry들을 쥐고 있지 않도록 */
+            lock_release(&e->lock);
+            disk_request_init(&ra_io[cnt], filesys_disk, sector, 1, ra_buf[cnt], false, NULL, NULL);
+            disk_submit(&ra_io[cnt]);
+            batch[cnt++] = e;
+        } while (cnt < READAHEAD_MAX && sema_try_down(&ra_sema));
+
+        for (i = 0; i < cnt; i++) {
+            struct cache_entry* e = batch[i];
+            disk_wait(&ra_io[i]);
+            /* valid가 아직 false이면 그 사이 아무도 이 sector를 읽거나 쓰지 않았음 */
+            lock_acquire(&e->lock);
+            if (!e->valid) {
+                memcpy(e->data, ra_buf[i], DISK_SECTOR_SIZE);
+                e->valid = true;
+            }
+            cache_put(e);
+        }
+    }
+}
@@ -1,15 +1,18 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
     struct inode* inode; /* Backing store. */
-    off_t pos;           /* Current position. */
+    off_t pos;           /* Next entry slot, counted across buckets. */
 };
 
 /* A single directory entry. */
@@ -19,11 +22,215 @@ struct dir_entry {
     bool in_use;                /* In use or free? */
 };
 
+/* On disk a directory is a header sector followed by BUCKET_CNT
+ * sector-sized buckets. An entry lives in the bucket its name hashes
+ * to or, if that one is full, in one of the buckets after it. Buckets
+ * past the end of the file, or never written, read as empty. */
+#define DIR_BUCKET_ENTRIES ((DISK_SECTOR_SIZE - sizeof(uint32_t)) / sizeof(struct dir_entry))
+
+/* Grow the bucket array when more than this fraction is in use. */
+#define DIR_LOAD_NUM 3
+#define DIR_LOAD_DEN 4
+
+/* Identifies a directory header. */
+#define DIR_MAGIC 0x44495248
+
+/* Directory header, at the start of the first sector. The rest of
+ * that sector is not used. */
+struct dir_header {
+    unsigned magic;      /* Magic number. */
+    uint32_t bucket_cnt; /* Number of buckets. */
+    uint32_t entry_cnt;  /* Number of entries in use. */
+};
+
+/* A bucket of directory entries.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct dir_bucket {
+    uint32_t overflow; /* An insertion went on past this full bucket. */
+    struct dir_entry entries[DIR_BUCKET_ENTRIES];
+    uint8_t unused[DISK_SECTOR_SIZE - sizeof(uint32_t) - DIR_BUCKET_ENTRIES * sizeof(struct dir_entry)];
+};
+
+/* Dentry cache: recently looked up names, keyed by directory
+ * sector and name, so that repeated lookups skip the directory file.
+ * Holds at most DCACHE_SIZE entries, dropping the least recently
+ * used. */
+#define DCACHE_SIZE 128
+
+struct dentry {
+    struct hash_elem hash_elem; /* Element in dcache. */
+    struct list_elem lru_elem;  /* Element in dcache_lru. */
+    disk_sector_t dir_sector;   /* Directory holding the name. */
+    disk_sector_t inode_sector; /* What the name refers to. */
+    char name[NAME_MAX + 1];    /* Null terminated file name. */
+};
+
+static struct hash dcache;
+static struct list dcache_lru; /* Most recently used at the front. */
+static struct lock dcache_lock;
+static bool dcache_ready;
+
+static uint64_t dentry_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+    const struct dentry* d = hash_entry(e, struct dentry, hash_elem);
+    return hash_string(d->name) ^ hash_int(d->dir_sector);
+}
+
+static bool dentry_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED)
+{
+    const struct dentry* a = hash_entry(a_, struct dentry, hash_elem);
+    const struct dentry* b = hash_entry(b_, struct dentry, hash_elem);
+
+    if (a->dir_sector != b->dir_sector)
+        return a->dir_sector < b->dir_sector;
+    return strcmp(a->name, b->name) < 0;
+}
+
+/* Returns the cached dentry for NAME in DIR_SECTOR, or a null pointer.
+ * The caller must hold dcache_lock. */
+static struct dentry* dcache_find(disk_sector_t dir_sector, const char* name)
+{
+    struct dentry key;
+    struct hash_elem* e;
+
+    key.dir_sector = dir_sector;
+    strlcpy(key.name, name, sizeof key.name);
+    e = hash_find(&dcache, &key.hash_elem);
+    return e != NULL ? hash_entry(e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in DIR_SECTOR in the dentry cache. On a hit stores
+ * the inode sector into *INODE_SECTOR and returns true. */
+static bool dcache_lookup(disk_sector_t dir_sector, const char* name, disk_sector_t* inode_sector)
+{
+    struct dentry* d;
+
+    if (!dcache_ready)
+        return false;
+    lock_acquire(&dcache_lock);
+    d = dcache_find(dir_sector, name);
+    if (d != NULL) {
+        list_remove(&d->lru_elem);
+        list_push_front(&dcache_lru, &d->lru_elem);
+        *inode_sector = d->inode_sector;
+    }
+    lock_release(&dcache_lock);
+    return d != NULL;
+}
+
+/* Records that NAME in DIR_SECTOR refers to INODE_SECTOR. */
+static void dcache_insert(disk_sector_t dir_sector, const char* name, disk_sector_t inode_sector)
+{
+    struct dentry* d;
+
+    if (!dcache_ready)
+        return;
+    lock_acquire(&dcache_lock);
+    d = dcache_find(dir_sector, name);
+    if (d != NULL)
+        list_remove(&d->lru_elem);
+    else if (hash_size(&dcache) >= DCACHE_SIZE) {
+        /* 가장 오래 쓰이지 않은 항목을 재사용 */
+        d = list_entry(list_pop_back(&dcache_lru), struct dentry, lru_elem);
+        hash_delete(&dcache, &d->hash_elem);
+    } else
+        d = malloc(sizeof *d);
+
+    if (d != NULL) {
+        d->dir_sector = dir_sector;
+        d->inode_sector = inode_sector;
+        strlcpy(d->name, name, sizeof d->name);
+        hash_insert(&dcache, &d->hash_elem);
+        list_push_front(&dcache_lru, &d->lru_elem);
+    }
+    lock_release(&dcache_lock);
+}
+
+/* Forgets NAME in DIR_SECTOR, and every name cached for a directory
+ * in INODE_SECTOR, which is about to be freed and may be reused. */
+static void dcache_remove(disk_sector_t dir_sector, const char* name, disk_sector_t inode_sector)
+{
+    struct list_elem* e;
+
+    if (!dcache_ready)
+        return;
+    lock_acquire(&dcache_lock);
+    for (e = list_begin(&dcache_lru); e != list_end(&dcache_lru);) {
+        struct dentry* d = list_entry(e, struct dentry, lru_elem);
+        e = list_next(e);
+        if (d->dir_sector == inode_sector || (d->dir_sector == dir_sector && !strcmp(d->name, name))) {
+            list_remove(&d->lru_elem);
+            hash_delete(&dcache, &d->hash_elem);
+            free(d);
+        }
+    }
+    lock_release(&dcache_lock);
+}
+
+/* Initializes the dentry cache. */
+void dir_init(void)
+{
+    hash_init(&dcache, dentry_hash, dentry_less, NULL);
+    list_init(&dcache_lru);
+    lock_init(&dcache_lock);
+    lock_register(&dcache_lock, "dentry cache");
+    dcache_ready = true;
+}
+
+/* Byte offset of bucket IDX in a directory file. */
+static off_t bucket_ofs(uint32_t idx)
+{
+    return (off_t)(idx + 1) * DISK_SECTOR_SIZE;
+}
+
+/* Reads bucket IDX of DIR into B. A bucket never written is empty. */
+static void read_bucket(const struct dir* dir, uint32_t idx, struct dir_bucket* b)
+{
+    off_t n = inode_read_at(dir->inode, b, sizeof *b, bucket_ofs(idx));
+    if (n < (off_t)sizeof *b)
+        memset((uint8_t*)b + n, 0, sizeof *b - n);
+}
+
+static bool write_bucket(struct dir* dir, uint32_t idx, const struct dir_bucket* b)
+{
+    return inode_write_at(dir->inode, b, sizeof *b, bucket_ofs(idx)) == sizeof *b;
+}
+
+static bool read_header(const struct dir* dir, struct dir_header* h)
+{
+    return inode_read_at(dir->inode, h, sizeof *h, 0) == sizeof *h && h->magic == DIR_MAGIC && h->bucket_cnt > 0;
+}
+
+static bool write_header(struct dir* dir, const struct dir_header* h)
+{
+    return inode_write_at(dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
- * given SECTOR.  Returns true if successful, false on failure. */
+ * given SECTOR.  Returns true if successful, false on failure.
+ * Only the header is written; the buckets start out as holes. */
 bool dir_create(disk_sector_t sector, size_t entry_cnt)
 {
-    return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
+    struct dir_header* h;
+    struct inode* inode;
+    bool success = false;
+
+    ASSERT(sizeof(struct dir_bucket) == DISK_SECTOR_SIZE);
+
+    if (!inode_create(sector, 0))
+        return false;
+    h = calloc(1, sizeof *h);
+    inode = inode_open(sector);
+    if (h != NULL && inode != NULL) {
+        h->magic = DIR_MAGIC;
+        h->bucket_cnt = DIV_ROUND_UP(entry_cnt * DIR_LOAD_DEN, DIR_BUCKET_ENTRIES * DIR_LOAD_NUM);
+        if (h->bucket_cnt == 0)
+            h->bucket_cnt = 1;
+        success = inode_write_at(inode, h, sizeof *h, 0) == sizeof *h;
+    }
+    inode_close(inode);
+    free(h);
+    return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -73,26 +280,45 @@ struct inode* dir_get_inode(struct dir* dir)
 
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
- * if EP is non-null, and sets *OFSP to the byte offset of the
- * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
-static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp)
+ * if EP is non-null, and sets *BUCKETP and *SLOTP to where the
+ * entry lives if they are non-null.
+ * otherwise, returns false and ignores EP, BUCKETP and SLOTP.
+ * Only the buckets from NAME's home bucket to the first one that
+ * never overflowed are read. */
+static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, uint32_t* bucketp, size_t* slotp)
 {
-    struct dir_entry e;
-    size_t ofs;
+    struct dir_header h;
+    struct dir_bucket* b;
+    bool found = false;
 
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
-    for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-        if (e.in_use && !strcmp(name, e.name)) {
-            if (ep != NULL)
-                *ep = e;
-            if (ofsp != NULL)
-                *ofsp = ofs;
-            return true;
+    if (!read_header(dir, &h) || (b = malloc(sizeof *b)) == NULL)
+        return false;
+
+    uint32_t idx = hash_string(name) % h.bucket_cnt;
+    for (uint32_t probe = 0; probe < h.bucket_cnt && !found; probe++) {
+        read_bucket(dir, idx, b);
+        for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+            struct dir_entry* e = &b->entries[i];
+            if (e->in_use && !strcmp(name, e->name)) {
+                if (ep != NULL)
+                    *ep = *e;
+                if (bucketp != NULL)
+                    *bucketp = idx;
+                if (slotp != NULL)
+                    *slotp = i;
+                found = true;
+                break;
+            }
         }
-    return false;
+        if (!b->overflow)
+            break;
+        idx = (idx + 1) % h.bucket_cnt;
+    }
+    free(b);
+    return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -102,18 +328,87 @@ static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep
 bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode)
 {
     struct dir_entry e;
+    disk_sector_t dir_sector;
+    disk_sector_t sector;
 
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
-    if (lookup(dir, name, &e, NULL))
+    dir_sector = inode_get_inumber(dir->inode);
+    rwlock_acquire_read(inode_dir_lock(dir->inode));
+    if (dcache_lookup(dir_sector, name, &sector))
+        *inode = inode_open(sector);
+    else if (lookup(dir, name, &e, NULL, NULL)) {
+        dcache_insert(dir_sector, name, e.inode_sector);
         *inode = inode_open(e.inode_sector);
-    else
+    } else
         *inode = NULL;
+    rwlock_release_read(inode_dir_lock(dir->inode));
 
     return *inode != NULL;
 }
 
+/* Puts an entry for NAME, INODE_SECTOR into the bucket array
+ * described by H, which must have a free slot. Buckets that are
+ * passed over because they are full are marked as overflowed. */
+static bool insert(struct dir* dir, struct dir_header* h, const char* name, disk_sector_t inode_sector,
+                   struct dir_bucket* b)
+{
+    uint32_t idx = hash_string(name) % h->bucket_cnt;
+
+    for (uint32_t probe = 0; probe < h->bucket_cnt; probe++) {
+        read_bucket(dir, idx, b);
+        for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+            struct dir_entry* e = &b->entries[i];
+            if (!e->in_use) {
+                e->in_use = true;
+                strlcpy(e->name, name, sizeof e->name);
+                e->inode_sector = inode_sector;
+                return write_bucket(dir, idx, b);
+            }
+        }
+        if (!b->overflow) {
+            b->overflow = true;
+            if (!write_bucket(dir, idx, b))
+                return false;
+        }
+        idx = (idx + 1) % h->bucket_cnt;
+    }
+    return false;
+}
+
+/* Doubles the number of buckets of DIR and rehashes every entry.
+ * Directories grow by doubling, so the cost is O(1) per entry added. */
+static bool grow(struct dir* dir, struct dir_header* h, struct dir_bucket* b)
+{
+    struct dir_entry* saved;
+    size_t cnt = 0;
+    bool success = true;
+
+    saved = malloc(h->entry_cnt * sizeof *saved);
+    if (saved == NULL)
+        return false;
+
+    /* 기존 항목을 모두 꺼내고 bucket을 비움 */
+    for (uint32_t idx = 0; idx < h->bucket_cnt; idx++) {
+        read_bucket(dir, idx, b);
+        for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+            if (b->entries[i].in_use && cnt < h->entry_cnt)
+                saved[cnt++] = b->entries[i];
+        if (bucket_ofs(idx) < inode_length(dir->inode)) {
+            memset(b, 0, sizeof *b);
+            success = success && write_bucket(dir, idx, b);
+        }
+    }
+
+    h->bucket_cnt *= 2;
+    for (size_t i = 0; i < cnt && success; i++)
+        success = insert(dir, h, saved[i].name, saved[i].inode_sector, b);
+    success = success && write_header(dir, h);
+    free(saved);
+    return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
  * file by that name.  The file's inode is in sector
  * INODE_SECTOR.
@@ -122,8 +417,8 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode)
  * error occurs. */
 bool dir_add(struct dir* dir, const char* name, disk_sector_t inode_sector)
 {
-    struct dir_entry e;
-    off_t ofs;
+    struct dir_header h;
+    struct dir_bucket* b = NULL;
     bool success = false;
 
     ASSERT(dir != NULL);
@@ -133,28 +428,29 @@ bool dir_add(struct dir* dir, const char* name, disk_sector_t inode_sector)
     if (*name == '\0' || strlen(name) > NAME_MAX)
         return false;
 
+    rwlock_acquire_write(inode_dir_lock(dir->inode));
+
     /* Check that NAME is not in use. */
-    if (lookup(dir, name, NULL, NULL))
+    if (lookup(dir, name, NULL, NULL, NULL))
         goto done;
 
-    /* Set OFS to offset of free slot.
-     * If there are no free slots, then it will be set to the
-     * current end-of-file.
+    if (!read_header(dir, &h) || (b = malloc(sizeof *b)) == NULL)
+        goto done;
 
-     * inode_read_at() will only return a short read at end of file.
-     * Otherwise, we'd need to verify that we didn't get a short
-     * read due to something intermittent such as low memory. */
-    for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-        if (!e.in_use)
-            break;
+    /* Keep the load factor low enough that probe sequences stay short. */
+    if ((h.entry_cnt + 1) * DIR_LOAD_DEN > h.bucket_cnt * DIR_BUCKET_ENTRIES * DIR_LOAD_NUM && !grow(dir, &h, b))
+        goto done;
 
-    /* Write slot. */
-    e.in_use = true;
-    strlcpy(e.name, name, sizeof e.name);
-    e.inode_sector = inode_sector;
-    success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+    if (!insert(dir, &h, name, inode_sector, b))
+        goto done;
+    h.entry_cnt++;
+    success = write_header(dir, &h);
+    if (success)
+        dcache_insert(inode_get_inumber(dir->inode), name, inode_sector);
 
 done:
+    rwlock_release_write(inode_dir_lock(dir->inode));
+    free(b);
     return success;
 }
 
@@ -163,16 +459,20 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool dir_remove(struct dir* dir, const char* name)
 {
+    struct dir_header h;
     struct dir_entry e;
     struct inode* inode = NULL;
     bool success = false;
-    off_t ofs;
+    uint32_t idx;
+    size_t slot;
 
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
+    rwlock_acquire_write(inode_dir_lock(dir->inode));
+
     /* Find directory entry. */
-    if (!lookup(dir, name, &e, &ofs))
+    if (!lookup(dir, name, &e, &idx, &slot) || !read_header(dir, &h))
         goto done;
 
     /* Open inode. */
@@ -180,16 +480,22 @@ bool dir_remove(struct dir* dir, const char* name)
     if (inode == NULL)
         goto done;
 
-    /* Erase directory entry. */
+    /* Erase directory entry. The bucket keeps its overflow mark, so
+     * entries that probed past it are still found. */
     e.in_use = false;
-    if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
+    if (inode_write_at(dir->inode, &e, sizeof e, bucket_ofs(idx) + offsetof(struct dir_bucket, entries) + slot * sizeof e) !=
+        sizeof e)
         goto done;
+    h.entry_cnt--;
+    write_header(dir, &h);
+    dcache_remove(inode_get_inumber(dir->inode), name, e.inode_sector);
 
     /* Remove inode. */
     inode_remove(inode);
     success = true;
 
 done:
+    rwlock_release_write(inode_dir_lock(dir->inode));
     inode_close(inode);
     return success;
 }
@@ -199,14 +505,29 @@ done:
  * contains no more entries. */
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1])
 {
-    struct dir_entry e;
+    struct dir_header h;
+    struct dir_bucket* b;
+    bool found = false;
 
-    while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-        dir->pos += sizeof e;
-        if (e.in_use) {
-            strlcpy(name, e.name, NAME_MAX + 1);
-            return true;
+    if ((b = malloc(sizeof *b)) == NULL)
+        return false;
+    rwlock_acquire_read(inode_dir_lock(dir->inode));
+    if (!read_header(dir, &h))
+        h.bucket_cnt = 0;
+
+    while (!found && (uint32_t)(dir->pos / DIR_BUCKET_ENTRIES) < h.bucket_cnt) {
+        uint32_t idx = dir->pos / DIR_BUCKET_ENTRIES;
+        read_bucket(dir, idx, b);
+        for (size_t i = dir->pos % DIR_BUCKET_ENTRIES; i < DIR_BUCKET_ENTRIES; i++) {
+            dir->pos++;
+            if (b->entries[i].in_use) {
+                strlcpy(name, b->entries[i].name, NAME_MAX + 1);
+                found = true;
+                break;
+            }
         }
     }
-    return false;
+    rwlock_release_read(inode_dir_lock(dir->inode));
+    free(b);
+    return found;
 }
@@ -51,6 +51,19 @@ void fat_init(void)
     fat_fs_init();
 }
 
+/* Returns how many whole FAT sectors, starting at FAT sector I,
+   can be moved by one disk command when BYTES_LEFT bytes of the
+   FAT remain. */
+static size_t fat_run_length(unsigned i, off_t bytes_left)
+{
+    size_t cnt = bytes_left / DISK_SECTOR_SIZE;
+    if (cnt > fat_fs->bs.fat_sectors - i)
+        cnt = fat_fs->bs.fat_sectors - i;
+    if (cnt > DISK_MAX_SECTORS)
+        cnt = DISK_MAX_SECTORS;
+    return cnt;
+}
+
 void fat_open(void)
 {
     fat_fs->fat = calloc(fat_fs->fat_length, sizeof(cluster_t));
@@ -62,11 +75,14 @@ void fat_open(void)
     off_t bytes_read = 0;
     off_t bytes_left = sizeof(fat_fs->fat);
     const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof(cluster_t);
-    for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
+    for (unsigned i = 0; i < fat_fs->bs.fat_sectors;) {
         bytes_left = fat_size_in_bytes - bytes_read;
         if (bytes_left >= DISK_SECTOR_SIZE) {
-            disk_read(filesys_disk, fat_fs->bs.fat_start + i, buffer + bytes_read);
-            bytes_read += DISK_SECTOR_SIZE;
+            // 온전한 섹터들은 명령 하나로 최대 DISK_MAX_SECTORS개씩
+            size_t cnt = fat_run_length(i, bytes_left);
+            disk_read_multi(filesys_disk, fat_fs->bs.fat_start + i, cnt, buffer + bytes_read);
+            bytes_read += cnt * DISK_SECTOR_SIZE;
+            i += cnt;
         } else {
             uint8_t* bounce = malloc(DISK_SECTOR_SIZE);
             if (bounce == NULL)
@@ -75,6 +91,7 @@ void fat_open(void)
             memcpy(buffer + bytes_read, bounce, bytes_left);
             bytes_read += bytes_left;
             free(bounce);
+            i++;
         }
     }
 }
@@ -94,11 +111,13 @@ void fat_close(void)
     off_t bytes_wrote = 0;
     off_t bytes_left = sizeof(fat_fs->fat);
     const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof(cluster_t);
-    for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
+    for (unsigned i = 0; i < fat_fs->bs.fat_sectors;) {
         bytes_left = fat_size_in_bytes - bytes_wrote;
         if (bytes_left >= DISK_SECTOR_SIZE) {
-            disk_write(filesys_disk, fat_fs->bs.fat_start + i, buffer + bytes_wrote);
-            bytes_wrote += DISK_SECTOR_SIZE;
+            size_t cnt = fat_run_length(i, bytes_left);
+            disk_write_multi(filesys_disk, fat_fs->bs.fat_start + i, cnt, buffer + bytes_wrote);
+            bytes_wrote += cnt * DISK_SECTOR_SIZE;
+            i += cnt;
         } else {
             bounce = calloc(1, DISK_SECTOR_SIZE);
             if (bounce == NULL)
@@ -107,6 +126,7 @@ void fat_close(void)
             disk_write(filesys_disk, fat_fs->bs.fat_start + i, bounce);
             bytes_wrote += bytes_left;
             free(bounce);
+            i++;
         }
     }
 }
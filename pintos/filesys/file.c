@@ -1,6 +1,9 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#ifdef EFILESYS
+#include "filesys/page_cache.h"
+#endif
 #include "threads/malloc.h"
 #include "lib/kernel/list.h"
 
@@ -70,7 +73,11 @@ struct inode* file_get_inode(struct file* file)
  * Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file* file, void* buffer, off_t size)
 {
+#ifdef EFILESYS
+    off_t bytes_read = page_cache_read(file->inode, buffer, size, file->pos);
+#else
     off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+#endif
     file->pos += bytes_read;
     return bytes_read;
 }
@@ -82,21 +89,28 @@ off_t file_read(struct file* file, void* buffer, off_t size)
  * The file's current position is unaffected. */
 off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs)
 {
+#ifdef EFILESYS
+    return page_cache_read(file->inode, buffer, size, file_ofs);
+#else
     return inode_read_at(file->inode, buffer, size, file_ofs);
+#endif
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file* file, const void* buffer, off_t size)
 {
     if (file->deny_write)
         return -1;
+#ifdef EFILESYS
+    off_t bytes_written = page_cache_write(file->inode, buffer, size, file->pos);
+#else
     off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+#endif
     file->pos += bytes_written;
     return bytes_written;
 }
@@ -104,13 +118,16 @@ off_t file_write(struct file* file, const void* buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t file_ofs)
 {
+#ifdef EFILESYS
+    return page_cache_write(file->inode, buffer, size, file_ofs);
+#else
     return inode_write_at(file->inode, buffer, size, file_ofs);
+#endif
 }
 
 /* Prevents write operations on FILE's underlying inode
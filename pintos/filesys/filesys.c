@@ -6,6 +6,10 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/buffer_cache.h"
+#ifdef EFILESYS
+#include "filesys/page_cache.h"
+#endif
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
@@ -21,7 +25,9 @@ void filesys_init(bool format)
     if (filesys_disk == NULL)
         PANIC("hd0:1 (hdb) not present, file system initialization failed");
 
+    buffer_cache_init();
     inode_init();
+    dir_init();
 
 #ifdef EFILESYS
     fat_init();
@@ -47,10 +53,12 @@ void filesys_done(void)
 {
     /* Original FS */
 #ifdef EFILESYS
+    page_cache_flush();
     fat_close();
 #else
     free_map_close();
 #endif
+    buffer_cache_done();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -1,67 +1,194 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#ifdef EFILESYS
+#include "filesys/page_cache.h"
+#endif
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of data sectors the inode points to directly. */
+#define DIRECT_CNT 123
+
+/* Number of sector numbers in an index block. */
+#define INDIRECT_CNT (DISK_SECTOR_SIZE / sizeof(disk_sector_t))
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * Data sectors are found through a multi-level block map and are
+ * allocated on first write. Sector 0 holds the free map inode and is
+ * never file data, so a 0 entry marks a hole that reads as zeros. */
 struct inode_disk {
-    disk_sector_t start;  /* First data sector. */
-    off_t length;         /* File size in bytes. */
-    unsigned magic;       /* Magic number. */
-    uint32_t unused[125]; /* Not used. */
+    off_t length;                     /* File size in bytes. */
+    unsigned magic;                   /* Magic number. */
+    disk_sector_t direct[DIRECT_CNT]; /* First data sectors. */
+    disk_sector_t indirect;           /* Index block of the next INDIRECT_CNT. */
+    disk_sector_t doubly_indirect;    /* Index block of index blocks. */
+    uint32_t unused[1];               /* Not used. */
 };
 
-/* Returns the number of sectors to allocate for an inode SIZE
- * bytes long. */
-static inline size_t bytes_to_sectors(off_t size)
-{
-    return DIV_ROUND_UP(size, DISK_SECTOR_SIZE);
-}
-
 /* In-memory inode. */
 struct inode {
-    struct list_elem elem;  /* Element in inode list. */
+    struct hash_elem elem;  /* Element in open inode table. */
     disk_sector_t sector;   /* Sector number of disk location. */
     int open_cnt;           /* Number of openers. */
     bool removed;           /* True if deleted, false otherwise. */
     int deny_write_cnt;     /* 0: writes ok, >0: deny writes. */
+    off_t ra_pos;           /* Where a sequential reader would read next. */
+    struct rwlock lock;     /* Protects DATA and DENY_WRITE_CNT. */
+    struct rwlock dir_lock; /* Protects the entries, if a directory. */
     struct inode_disk data; /* Inode content. */
 };
 
+/* Allocates a sector, zeroes it and stores it into *SECTORP.
+ * The zeroes only go to the buffer cache; nothing is read from disk. */
+static bool allocate_zeroed(disk_sector_t* sectorp)
+{
+    static char zeros[DISK_SECTOR_SIZE];
+
+    if (!free_map_allocate(1, sectorp))
+        return false;
+    buffer_cache_write(*sectorp, zeros, 0, DISK_SECTOR_SIZE);
+    return true;
+}
+
+/* Returns the sector in SLOT, a block map entry held in INODE's
+ * on-disk inode. If it is a hole and CREATE is true, fills it first.
+ * Returns 0 for a hole or if allocation fails. */
+static disk_sector_t slot_lookup(struct inode* inode, disk_sector_t* slot, bool create)
+{
+    if (*slot == 0 && create && allocate_zeroed(slot))
+        buffer_cache_write(inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+    return *slot;
+}
+
+/* Same as slot_lookup() for entry IDX of index block BLOCK. */
+static disk_sector_t index_lookup(disk_sector_t block, size_t idx, bool create)
+{
+    disk_sector_t sector;
+
+    buffer_cache_read(block, &sector, idx * sizeof sector, sizeof sector);
+    if (sector == 0 && create && allocate_zeroed(&sector))
+        buffer_cache_write(block, &sector, idx * sizeof sector, sizeof sector);
+    return sector;
+}
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
- * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
-static disk_sector_t byte_to_sector(const struct inode* inode, off_t pos)
+ * INODE. If that part of the file is a hole and CREATE is true,
+ * allocates the sector and any index blocks leading to it.
+ * Returns 0 for a hole, if allocation fails, or if POS is beyond the
+ * largest file the block map can describe. */
+static disk_sector_t byte_to_sector(struct inode* inode, off_t pos, bool create)
 {
+    struct inode_disk* data = &inode->data;
+    size_t idx = pos / DISK_SECTOR_SIZE;
+    disk_sector_t block;
+
     ASSERT(inode != NULL);
-    if (pos < inode->data.length)
-        return inode->data.start + pos / DISK_SECTOR_SIZE;
-    else
-        return -1;
+    ASSERT(pos >= 0);
+
+    if (idx < DIRECT_CNT)
+        return slot_lookup(inode, &data->direct[idx], create);
+    idx -= DIRECT_CNT;
+
+    if (idx < INDIRECT_CNT) {
+        block = slot_lookup(inode, &data->indirect, create);
+        return block != 0 ? index_lookup(block, idx, create) : 0;
+    }
+    idx -= INDIRECT_CNT;
+
+    if (idx < INDIRECT_CNT * INDIRECT_CNT) {
+        block = slot_lookup(inode, &data->doubly_indirect, create);
+        if (block != 0)
+            block = index_lookup(block, idx / INDIRECT_CNT, create);
+        return block != 0 ? index_lookup(block, idx % INDIRECT_CNT, create) : 0;
+    }
+    return 0;
+}
+
+/* Frees index block BLOCK, LEVEL levels above the data sectors, and
+ * everything below it. */
+static void release_index(disk_sector_t block, int level)
+{
+    if (level > 0) {
+        disk_sector_t entries[INDIRECT_CNT];
+        size_t i;
+
+        buffer_cache_read(block, entries, 0, DISK_SECTOR_SIZE);
+        for (i = 0; i < INDIRECT_CNT; i++)
+            if (entries[i] != 0)
+                release_index(entries[i], level - 1);
+    }
+    free_map_release(block, 1);
+}
+
+/* Frees every data and index sector of DATA. */
+static void release_blocks(struct inode_disk* data)
+{
+    size_t i;
+
+    for (i = 0; i < DIRECT_CNT; i++)
+        if (data->direct[i] != 0)
+            free_map_release(data->direct[i], 1);
+    if (data->indirect != 0)
+        release_index(data->indirect, 1);
+    if (data->doubly_indirect != 0)
+        release_index(data->doubly_indirect, 2);
+}
+
+/* Table of open inodes keyed by sector, so that opening a single
+ * inode twice returns the same `struct inode'. open_inodes_lock
+ * protects the table and every inode's OPEN_CNT and REMOVED. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Where `struct inode's are allocated. */
+static struct kmem_cache* inode_cache;
+
+static uint64_t inode_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+    const struct inode* inode = hash_entry(e, struct inode, elem);
+    return hash_int(inode->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED)
+{
+    return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
+
+/* Constructs a cached inode.  Its locks are free whenever it goes
+ * back to the cache, so they are initialized only once. */
+static void inode_ctor(void* inode_)
+{
+    struct inode* inode = inode_;
+    rwlock_init(&inode->lock);
+    rwlock_init(&inode->dir_lock);
+}
 
 /* Initializes the inode module. */
 void inode_init(void)
 {
-    list_init(&open_inodes);
+    inode_cache = kmem_cache_create("inode", sizeof(struct inode), 0, inode_ctor);
+    if (inode_cache == NULL)
+        PANIC("inode_init: out of memory");
+    hash_init(&open_inodes, inode_hash, inode_less, NULL);
+    lock_init(&open_inodes_lock);
+    lock_register(&open_inodes_lock, "open inodes");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * disk.
+ * disk. The data starts out as one hole; sectors are allocated
+ * when written.
  * Returns true if successful.
  * Returns false if memory or disk allocation fails. */
 bool inode_create(disk_sector_t sector, off_t length)
@@ -77,20 +204,10 @@ bool inode_create(disk_sector_t sector, off_t length)
 
     disk_inode = calloc(1, sizeof *disk_inode);
     if (disk_inode != NULL) {
-        size_t sectors = bytes_to_sectors(length);
         disk_inode->length = length;
         disk_inode->magic = INODE_MAGIC;
-        if (free_map_allocate(sectors, &disk_inode->start)) {
-            disk_write(filesys_disk, sector, disk_inode);
-            if (sectors > 0) {
-                static char zeros[DISK_SECTOR_SIZE];
-                size_t i;
-
-                for (i = 0; i < sectors; i++)
-                    disk_write(filesys_disk, disk_inode->start + i, zeros);
-            }
-            success = true;
-        }
+        buffer_cache_write(sector, disk_inode, 0, DISK_SECTOR_SIZE);
+        success = true;
         free(disk_inode);
     }
     return success;
@@ -101,38 +218,49 @@ bool inode_create(disk_sector_t sector, off_t length)
  * Returns a null pointer if memory allocation fails. */
 struct inode* inode_open(disk_sector_t sector)
 {
-    struct list_elem* e;
+    struct inode key;
+    struct hash_elem* e;
     struct inode* inode;
 
+    lock_acquire(&open_inodes_lock);
+
     /* Check whether this inode is already open. */
-    for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-        inode = list_entry(e, struct inode, elem);
-        if (inode->sector == sector) {
-            inode_reopen(inode);
-            return inode;
-        }
+    key.sector = sector;
+    e = hash_find(&open_inodes, &key.elem);
+    if (e != NULL) {
+        inode = hash_entry(e, struct inode, elem);
+        inode->open_cnt++;
+        lock_release(&open_inodes_lock);
+        return inode;
     }
 
     /* Allocate memory. */
-    inode = malloc(sizeof *inode);
-    if (inode == NULL)
+    inode = kmem_cache_alloc(inode_cache);
+    if (inode == NULL) {
+        lock_release(&open_inodes_lock);
         return NULL;
+    }
 
     /* Initialize. */
-    list_push_front(&open_inodes, &inode->elem);
     inode->sector = sector;
     inode->open_cnt = 1;
     inode->deny_write_cnt = 0;
     inode->removed = false;
-    disk_read(filesys_disk, inode->sector, &inode->data);
+    inode->ra_pos = 0;
+    buffer_cache_read(inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+    hash_insert(&open_inodes, &inode->elem);
+    lock_release(&open_inodes_lock);
     return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode)
 {
-    if (inode != NULL)
+    if (inode != NULL) {
+        lock_acquire(&open_inodes_lock);
         inode->open_cnt++;
+        lock_release(&open_inodes_lock);
+    }
     return inode;
 }
 
@@ -151,19 +279,27 @@ void inode_close(struct inode* inode)
     if (inode == NULL)
         return;
 
-    /* Release resources if this was the last opener. */
+    /* Release resources if this was the last opener. The table lock
+     * is held throughout, so that a concurrent inode_open() cannot
+     * read the sector before the last writes reach it. */
+    lock_acquire(&open_inodes_lock);
     if (--inode->open_cnt == 0) {
-        /* Remove from inode list and release lock. */
-        list_remove(&inode->elem);
+#ifdef EFILESYS
+        /* Write back and drop the cached pages while INODE is still valid. */
+        page_cache_release_inode(inode);
+#endif
+        /* Remove from inode table. */
+        hash_delete(&open_inodes, &inode->elem);
 
         /* Deallocate blocks if removed. */
         if (inode->removed) {
             free_map_release(inode->sector, 1);
-            free_map_release(inode->data.start, bytes_to_sectors(inode->data.length));
+            release_blocks(&inode->data);
         }
 
-        free(inode);
+        kmem_cache_free(inode_cache, inode);
     }
+    lock_release(&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -171,25 +307,33 @@ void inode_close(struct inode* inode)
 void inode_remove(struct inode* inode)
 {
     ASSERT(inode != NULL);
+    lock_acquire(&open_inodes_lock);
     inode->removed = true;
+    lock_release(&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
+ * than SIZE if an error occurs or end of file is reached.
+ * A read that continues where the previous one stopped queues the
+ * following sector for read-ahead. */
 off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset)
 {
     uint8_t* buffer = buffer_;
     off_t bytes_read = 0;
-    uint8_t* bounce = NULL;
+    bool sequential = offset == inode->ra_pos;
 
     while (size > 0) {
-        /* Disk sector to read, starting byte offset within sector. */
-        disk_sector_t sector_idx = byte_to_sector(inode, offset);
+        /* Disk sector to read, starting byte offset within sector.
+         * Only the lookup is done under the inode lock; the copy may
+         * fault on BUFFER. */
+        rwlock_acquire_read(&inode->lock);
+        disk_sector_t sector_idx = byte_to_sector(inode, offset, false);
+        off_t inode_left = inode_length(inode) - offset;
+        rwlock_release_read(&inode->lock);
         int sector_ofs = offset % DISK_SECTOR_SIZE;
 
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
-        off_t inode_left = inode_length(inode) - offset;
         int sector_left = DISK_SECTOR_SIZE - sector_ofs;
         int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -198,89 +342,84 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
         if (chunk_size <= 0)
             break;
 
-        if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-            /* Read full sector directly into caller's buffer. */
-            disk_read(filesys_disk, sector_idx, buffer + bytes_read);
-        } else {
-            /* Read sector into bounce buffer, then partially copy
-             * into caller's buffer. */
-            if (bounce == NULL) {
-                bounce = malloc(DISK_SECTOR_SIZE);
-                if (bounce == NULL)
-                    break;
-            }
-            disk_read(filesys_disk, sector_idx, bounce);
-            memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+        if (sector_idx != 0)
+            buffer_cache_read(sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+        else
+            memset(buffer + bytes_read, 0, chunk_size);
 
         /* Advance. */
         size -= chunk_size;
         offset += chunk_size;
         bytes_read += chunk_size;
     }
-    free(bounce);
+
+    if (sequential && bytes_read > 0) {
+        off_t next_ofs = ROUND_UP(offset, DISK_SECTOR_SIZE);
+        rwlock_acquire_read(&inode->lock);
+        disk_sector_t next = next_ofs < inode_length(inode) ? byte_to_sector(inode, next_ofs, false) : 0;
+        rwlock_release_read(&inode->lock);
+        if (next != 0)
+            buffer_cache_readahead(next);
+    }
+    inode->ra_pos = offset;
 
     return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or the file would exceed
+ * the largest size the block map can describe.
+ * A write past end of file extends INODE; any gap before OFFSET
+ * is left as a hole. */
 off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset)
 {
     const uint8_t* buffer = buffer_;
     off_t bytes_written = 0;
-    uint8_t* bounce = NULL;
 
-    if (inode->deny_write_cnt)
+    if (inode_write_denied(inode))
         return 0;
 
     while (size > 0) {
         /* Sector to write, starting byte offset within sector. */
-        disk_sector_t sector_idx = byte_to_sector(inode, offset);
+        /* Overwriting allocated sectors only needs the read side;
+         * filling a hole changes the block map. */
+        rwlock_acquire_read(&inode->lock);
+        disk_sector_t sector_idx = byte_to_sector(inode, offset, false);
+        rwlock_release_read(&inode->lock);
+        if (sector_idx == 0) {
+            rwlock_acquire_write(&inode->lock);
+            sector_idx = byte_to_sector(inode, offset, true);
+            rwlock_release_write(&inode->lock);
+        }
         int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-        /* Bytes left in inode, bytes left in sector, lesser of the two. */
-        off_t inode_left = inode_length(inode) - offset;
+        /* Bytes left in sector. */
         int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-        int min_left = inode_left < sector_left ? inode_left : sector_left;
 
         /* Number of bytes to actually write into this sector. */
-        int chunk_size = size < min_left ? size : min_left;
-        if (chunk_size <= 0)
+        int chunk_size = size < sector_left ? size : sector_left;
+        if (sector_idx == 0)
             break;
 
-        if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-            /* Write full sector directly to disk. */
-            disk_write(filesys_disk, sector_idx, buffer + bytes_written);
-        } else {
-            /* We need a bounce buffer. */
-            if (bounce == NULL) {
-                bounce = malloc(DISK_SECTOR_SIZE);
-                if (bounce == NULL)
-                    break;
-            }
-
-            /* If the sector contains data before or after the chunk
-               we're writing, then we need to read in the sector
-               first.  Otherwise we start with a sector of all zeros. */
-            if (sector_ofs > 0 || chunk_size < sector_left)
-                disk_read(filesys_disk, sector_idx, bounce);
-            else
-                memset(bounce, 0, DISK_SECTOR_SIZE);
-            memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-            disk_write(filesys_disk, sector_idx, bounce);
-        }
+        /* The cache reads the rest of a partially written sector
+         * itself, and skips the read for a whole sector. */
+        buffer_cache_write(sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
         /* Advance. */
         size -= chunk_size;
         offset += chunk_size;
         bytes_written += chunk_size;
     }
-    free(bounce);
 
+    if (offset > inode_length(inode)) {
+        rwlock_acquire_write(&inode->lock);
+        if (offset > inode->data.length) {
+            inode->data.length = offset;
+            buffer_cache_write(inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+        }
+        rwlock_release_write(&inode->lock);
+    }
     return bytes_written;
 }
 
@@ -288,8 +427,10 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
    May be called at most once per inode opener. */
 void inode_deny_write(struct inode* inode)
 {
+    rwlock_acquire_write(&inode->lock);
     inode->deny_write_cnt++;
     ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+    rwlock_release_write(&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -297,9 +438,26 @@ void inode_deny_write(struct inode* inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void inode_allow_write(struct inode* inode)
 {
+    rwlock_acquire_write(&inode->lock);
     ASSERT(inode->deny_write_cnt > 0);
     ASSERT(inode->deny_write_cnt <= inode->open_cnt);
     inode->deny_write_cnt--;
+    rwlock_release_write(&inode->lock);
+}
+
+/* Returns true if writes to INODE are currently denied. */
+bool inode_write_denied(const struct inode* inode)
+{
+    return inode->deny_write_cnt > 0;
+}
+
+/* Returns the lock that serializes directory operations on INODE.
+ * Lookups take it for reading; adding and removing entries take it
+ * for writing. It is separate from the inode lock, which the
+ * directory's own reads and writes take. */
+struct rwlock* inode_dir_lock(struct inode* inode)
+{
+    return &inode->dir_lock;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -1,9 +1,30 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
 #include "vm/vm.h"
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef EFILESYS
+
+/* Ticks between two runs of the worker daemon. */
+#define PAGE_CACHE_FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Pages taken out of the table at once when dropping entries. */
+#define PAGE_CACHE_BATCH 32
+
 static bool page_cache_readahead(struct page* page, void* kva);
 static bool page_cache_writeback(struct page* page);
 static void page_cache_destroy(struct page* page);
+static void page_cache_kworkerd(void* aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -15,10 +36,42 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* Cached pages, keyed by (inode, offset). Entries are created, claimed
+ * and dropped only with page_cache_lock held; eviction runs without it
+ * and is kept out by pinning the frame. */
+static struct hash page_cache_table;
+static struct lock page_cache_lock;
+
+/* False until pagecache_init(). The file system is brought up before
+ * the VM, so early accesses go straight to the inode. */
+static bool page_cache_enabled;
+
+/* File data goes through the page cache; the free map does not.
+ * Allocating a sector rewrites the free map, which may happen while
+ * page_cache_lock is held for a writeback. */
+#define page_cache_bypass(INODE) (!page_cache_enabled || inode_get_inumber(INODE) == FREE_MAP_SECTOR)
+
+static uint64_t page_cache_hash(const struct hash_elem* e, void* aux);
+static bool page_cache_less(const struct hash_elem* a, const struct hash_elem* b, void* aux);
+static struct page* page_cache_lookup(struct inode* inode, off_t offset);
+static struct page* page_cache_create(struct inode* inode, off_t offset);
+static struct page* page_cache_get(struct inode* inode, off_t offset);
+static off_t page_cache_extend(struct inode* inode, const uint8_t* buffer, off_t size, off_t offset);
+static bool page_cache_write_page(struct page* page);
+static size_t page_cache_collect(struct page** pages, bool (*pred)(struct page*, void*), void* aux);
+static bool is_inode_page(struct page* page, void* inode);
+static bool is_evicted_page(struct page* page, void* aux);
+static void page_cache_reap(void);
+
 /* The initializer of file vm */
 void pagecache_init(void)
 {
     /* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+    hash_init(&page_cache_table, page_cache_hash, page_cache_less, NULL);
+    lock_init(&page_cache_lock);
+    lock_register(&page_cache_lock, "page cache");
+    page_cache_enabled = true;
+    page_cache_workerd = thread_create("page_cache_kworkerd", PRI_DEFAULT, page_cache_kworkerd, NULL);
 }
 
 /* Initialize the page cache */
@@ -26,24 +79,420 @@ bool page_cache_initializer(struct page* page, enum vm_type type, void* kva)
 {
     /* Set up the handler */
     page->operations = &page_cache_op;
+    return true;
+}
+
+/* Reads SIZE bytes of INODE starting at OFFSET into BUFFER through the
+ * page cache. Returns the number of bytes read, which is short at end
+ * of file or if the cache runs out of memory. */
+off_t page_cache_read(struct inode* inode, void* buffer_, off_t size, off_t offset)
+{
+    uint8_t* buffer = buffer_;
+    off_t bytes_read = 0;
+
+    if (page_cache_bypass(inode))
+        return inode_read_at(inode, buffer, size, offset);
+
+    while (size > 0) {
+        off_t page_ofs = offset % PGSIZE;
+        off_t inode_left = inode_length(inode) - offset;
+        off_t chunk_size = PGSIZE - page_ofs;
+        if (chunk_size > size)
+            chunk_size = size;
+        if (chunk_size > inode_left)
+            chunk_size = inode_left;
+        if (chunk_size <= 0)
+            break;
+
+        struct page* page = page_cache_get(inode, offset - page_ofs);
+        if (page == NULL)
+            break;
+        /* 프레임이 pin 되어 있으므로 복사 중 buffer에서 page fault가 나도 쫓겨나지 않음 */
+        memcpy(buffer + bytes_read, (uint8_t*)page->frame->kva + page_ofs, chunk_size);
+        page->page_cache.accessed = true;
+        vm_unpin_frame(page->frame);
+
+        size -= chunk_size;
+        offset += chunk_size;
+        bytes_read += chunk_size;
+    }
+    return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE starting at OFFSET through
+ * the page cache. The data reaches the disk when the page is evicted
+ * or flushed by the worker daemon. Returns the number of bytes
+ * written. */
+off_t page_cache_write(struct inode* inode, const void* buffer_, off_t size, off_t offset)
+{
+    const uint8_t* buffer = buffer_;
+    off_t bytes_written = 0;
+
+    if (page_cache_bypass(inode))
+        return inode_write_at(inode, buffer, size, offset);
+    if (inode_write_denied(inode))
+        return 0;
+
+    while (size > 0) {
+        off_t page_ofs = offset % PGSIZE;
+        off_t inode_left = inode_length(inode) - offset;
+        off_t chunk_size = PGSIZE - page_ofs;
+        if (chunk_size > size)
+            chunk_size = size;
+        if (chunk_size > inode_left)
+            chunk_size = inode_left;
+        if (chunk_size <= 0)
+            break;
+
+        struct page* page = page_cache_get(inode, offset - page_ofs);
+        if (page == NULL)
+            return bytes_written;
+        memcpy((uint8_t*)page->frame->kva + page_ofs, buffer + bytes_written, chunk_size);
+        page->page_cache.accessed = true;
+        page->page_cache.dirty = true;
+        vm_unpin_frame(page->frame);
+
+        size -= chunk_size;
+        offset += chunk_size;
+        bytes_written += chunk_size;
+    }
+
+    if (size > 0)
+        bytes_written += page_cache_extend(inode, buffer + bytes_written, size, offset);
+    return bytes_written;
+}
+
+/* Writes past the end of INODE, which only the inode layer knows how to
+ * do. The data goes to disk directly and the cached page that holds
+ * the old end of file, if any, is patched so that it does not go
+ * stale. */
+static off_t page_cache_extend(struct inode* inode, const uint8_t* buffer, off_t size, off_t offset)
+{
+    off_t bytes_written = 0;
+    uint8_t* bounce = palloc_get_page(0);
+    if (bounce == NULL)
+        return 0;
+
+    while (size > 0) {
+        off_t page_ofs = offset % PGSIZE;
+        off_t chunk_size = PGSIZE - page_ofs < size ? PGSIZE - page_ofs : size;
+
+        /* page_cache_lock을 쥔 채 사용자 buffer에서 page fault가 나면 mmap 처리에서
+         * 같은 lock을 다시 잡으므로 먼저 커널 버퍼로 복사 */
+        memcpy(bounce, buffer + bytes_written, chunk_size);
+
+        /* lock을 쥐고 있는 동안에는 이 페이지를 디스크에서 새로 읽어 올 수 없음.
+         * pin을 기다릴 때는 lock을 놓음: pin을 쥔 스레드가 mmap fault로 lock을 기다릴 수 있음 */
+        struct page* page;
+        for (;;) {
+            struct frame* frame;
+            lock_acquire(&page_cache_lock);
+            page = page_cache_lookup(inode, offset - page_ofs);
+            if (page == NULL || (frame = page->frame) == NULL || vm_pin_page(page))
+                break;
+            lock_release(&page_cache_lock);
+            /* lock을 놓은 뒤에는 page가 해제될 수 있으므로 프레임을 기다림 */
+            vm_wait_frame(frame);
+        }
+        if (page != NULL && page->frame != NULL) {
+            memcpy((uint8_t*)page->frame->kva + page_ofs, bounce, chunk_size);
+            vm_unpin_frame(page->frame);
+        }
+        off_t written = inode_write_at(inode, bounce, chunk_size, offset);
+        lock_release(&page_cache_lock);
+
+        bytes_written += written;
+        if (written < chunk_size)
+            break;
+        size -= chunk_size;
+        offset += chunk_size;
+    }
+    palloc_free_page(bounce);
+    return bytes_written;
+}
+
+/* Faults in PAGE, a page of an mmapped file, by mapping the frame of the
+ * cached copy instead of reading the file a second time. Reads, writes
+ * and every mapping of the file then see the same data. */
+bool page_cache_map(struct page* page)
+{
+    if (VM_TYPE(page->operations->type) == VM_UNINIT) {
+        /* 내용은 page cache에서 가져오므로 초기화 콜백(파일 읽기)은 생략 */
+        void* aux = page->uninit.aux;
+        if (!page->uninit.page_initializer(page, page->uninit.type, NULL))
+            return false;
+        free(aux);
+    }
+
+    struct file_page* file_page = &page->file;
+    struct inode* inode = file_get_inode(file_page->file);
+    ASSERT(file_page->offset % PGSIZE == 0);
+
+    /* pin 하지 않음: read()가 이 페이지를 pin 한 채 같은 페이지로 fault 할 수 있음 */
+    lock_acquire(&page_cache_lock);
+    struct page* cache = page_cache_lookup(inode, file_page->offset);
+    if (cache == NULL)
+        cache = page_cache_create(inode, file_page->offset);
+    while (cache != NULL && !vm_share_frame(cache, page)) {
+        /* 쫓겨나는 중이면 기다림: writeback은 page_cache_lock을 잡지 않음.
+         * 고정되지 않았는데 실패했으면 매핑할 메모리가 없음 */
+        if (cache->frame != NULL) {
+            if (!vm_wait_page(cache))
+                cache = NULL;
+        } else if (!vm_claim_kernel_page(cache))
+            cache = NULL;
+    }
+    if (cache != NULL)
+        cache->page_cache.accessed = true;
+    lock_release(&page_cache_lock);
+    return cache != NULL;
+}
+
+/* Tears down PAGE's mapping of a cached file page. Whether the process
+ * wrote to it is only known from its page table, so the dirty bit is
+ * handed to the cached copy before the mapping goes away. */
+void page_cache_unmap(struct page* page)
+{
+    struct thread* owner = page->accessible_thread;
+    bool dirty = pml4_is_dirty(owner->pml4, page->va);
+
+    pml4_clear_page(owner->pml4, page->va);
+    if (dirty) {
+        lock_acquire(&page_cache_lock);
+        struct page* cache = page_cache_lookup(file_get_inode(page->file.file), page->file.offset);
+        if (cache != NULL)
+            cache->page_cache.dirty = true;
+        lock_release(&page_cache_lock);
+    }
+    vm_release_frame(page);
+}
+
+/* Writes back and drops every cached page of INODE. Called when its
+ * last opener closes it, so no entry outlives the inode. */
+void page_cache_release_inode(struct inode* inode)
+{
+    struct page* pages[PAGE_CACHE_BATCH];
+    size_t cnt;
+
+    if (!page_cache_enabled)
+        return;
+
+    lock_acquire(&page_cache_lock);
+    do {
+        cnt = page_cache_collect(pages, is_inode_page, inode);
+        for (size_t i = 0; i < cnt; i++) {
+            struct page* page = pages[i];
+            /* 쫓겨나는 중이면 끝날 때까지 기다림 */
+            while (page->frame != NULL && !vm_pin_page(page))
+                vm_wait_page(page);
+            destroy(page);
+            kmem_cache_free(page_slab, page);
+        }
+    } while (cnt == PAGE_CACHE_BATCH);
+    lock_release(&page_cache_lock);
+}
+
+/* Writes every dirty resident page back to disk. Pages that are in use
+ * are skipped; they will be written next time. */
+void page_cache_flush(void)
+{
+    struct hash_iterator i;
+
+    if (!page_cache_enabled)
+        return;
+
+    lock_acquire(&page_cache_lock);
+    hash_first(&i, &page_cache_table);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, page_cache.elem);
+        if (page->page_cache.dirty && vm_pin_page(page)) {
+            page_cache_write_page(page);
+            vm_unpin_frame(page->frame);
+        }
+    }
+    lock_release(&page_cache_lock);
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool page_cache_readahead(struct page* page, void* kva)
 {
+    struct page_cache* page_cache = &page->page_cache;
+    off_t read_bytes = inode_length(page_cache->inode) - page_cache->offset;
+
+    if (read_bytes > PGSIZE)
+        read_bytes = PGSIZE;
+    if (read_bytes < 0)
+        read_bytes = 0;
+    if (inode_read_at(page_cache->inode, kva, read_bytes, page_cache->offset) != read_bytes)
+        return false;
+    memset((uint8_t*)kva + read_bytes, 0, PGSIZE - read_bytes);
+    page_cache->accessed = true;
+    page_cache->dirty = false;
+    return true;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool page_cache_writeback(struct page* page)
 {
+    if (!page_cache_write_page(page))
+        return false;
+    page->frame = NULL;
+    return true;
 }
 
 /* Destory the page_cache. */
 static void page_cache_destroy(struct page* page)
 {
+    if (page->frame != NULL) {
+        page_cache_write_page(page);
+        vm_release_frame(page);
+    }
 }
 
 /* Worker thread for page cache */
-static void page_cache_kworkerd(void* aux)
+static void page_cache_kworkerd(void* aux UNUSED)
+{
+    for (;;) {
+        timer_sleep(PAGE_CACHE_FLUSH_INTERVAL);
+        page_cache_flush();
+        page_cache_reap();
+    }
+}
+
+/* Writes resident PAGE back to its file if it is dirty. Only the part
+ * below the end of file is written. */
+static bool page_cache_write_page(struct page* page)
+{
+    struct page_cache* page_cache = &page->page_cache;
+    off_t write_bytes = inode_length(page_cache->inode) - page_cache->offset;
+
+    if (!page_cache->dirty)
+        return true;
+    if (write_bytes > PGSIZE)
+        write_bytes = PGSIZE;
+    if (write_bytes > 0 && inode_write_at(page_cache->inode, page->frame->kva, write_bytes, page_cache->offset) != write_bytes)
+        return false;
+    page_cache->dirty = false;
+    return true;
+}
+
+/* Frees the entries whose pages have been evicted. They hold no data;
+ * only the table references them. */
+static void page_cache_reap(void)
+{
+    struct page* pages[PAGE_CACHE_BATCH];
+    size_t cnt;
+
+    do {
+        lock_acquire(&page_cache_lock);
+        cnt = page_cache_collect(pages, is_evicted_page, NULL);
+        lock_release(&page_cache_lock);
+        for (size_t i = 0; i < cnt; i++)
+            kmem_cache_free(page_slab, pages[i]);
+    } while (cnt == PAGE_CACHE_BATCH);
+}
+
+/* Removes up to PAGE_CACHE_BATCH entries for which PRED holds from the
+ * table and stores them in PAGES. Returns the number removed. The
+ * caller must hold page_cache_lock. */
+static size_t page_cache_collect(struct page** pages, bool (*pred)(struct page*, void*), void* aux)
 {
+    struct hash_iterator i;
+    size_t cnt = 0;
+
+    hash_first(&i, &page_cache_table);
+    while (cnt < PAGE_CACHE_BATCH && hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, page_cache.elem);
+        if (pred(page, aux))
+            pages[cnt++] = page;
+    }
+    /* 순회가 끝난 뒤에 삭제: 순회 중 hash_delete는 iterator를 무효화함 */
+    for (size_t k = 0; k < cnt; k++)
+        hash_delete(&page_cache_table, &pages[k]->page_cache.elem);
+    return cnt;
+}
+
+static bool is_inode_page(struct page* page, void* inode)
+{
+    return page->page_cache.inode == inode;
+}
+
+/* A page whose frame is gone. page_cache_lock keeps it from being
+ * claimed again, and eviction no longer touches it. */
+static bool is_evicted_page(struct page* page, void* aux UNUSED)
+{
+    return page->frame == NULL;
+}
+
+/* Returns the cached page of INODE at OFFSET, resident and with its frame
+ * pinned, creating and reading it in as needed. Returns a null pointer
+ * if memory runs out. Undo with vm_unpin_frame(). */
+static struct page* page_cache_get(struct inode* inode, off_t offset)
+{
+    for (;;) {
+        struct page* page;
+        struct frame* frame = NULL;
+        bool pinned = false;
+
+        lock_acquire(&page_cache_lock);
+        page = page_cache_lookup(inode, offset);
+        if (page == NULL)
+            page = page_cache_create(inode, offset);
+        if (page != NULL) {
+            if (page->frame == NULL && !vm_claim_kernel_page(page))
+                page = NULL;
+            else if (!(pinned = vm_pin_page(page)))
+                frame = page->frame;
+        }
+        lock_release(&page_cache_lock);
+        if (page == NULL || pinned)
+            return page;
+
+        /* 다른 스레드가 쓰고 있거나 쫓겨나는 중. lock을 놓았으므로 page가 아닌 프레임을
+         * 기다리고, 다음에는 다시 찾음: 그 사이 reaper가 해제했을 수 있음 */
+        if (frame != NULL)
+            vm_wait_frame(frame);
+    }
+}
+
+static struct page* page_cache_lookup(struct inode* inode, off_t offset)
+{
+    struct page key;
+    struct hash_elem* e;
+
+    key.page_cache.inode = inode;
+    key.page_cache.offset = offset;
+    e = hash_find(&page_cache_table, &key.page_cache.elem);
+    return e != NULL ? hash_entry(e, struct page, page_cache.elem) : NULL;
+}
+
+/* Adds a non-resident entry for INODE at OFFSET to the table. */
+static struct page* page_cache_create(struct inode* inode, off_t offset)
+{
+    struct page* page = kmem_cache_alloc(page_slab);
+    if (page == NULL)
+        return NULL;
+
+    *page = (struct page){.va = NULL, .frame = NULL, .writable = true, .accessible_thread = NULL};
+    page_cache_initializer(page, VM_PAGE_CACHE, NULL);
+    page->page_cache = (struct page_cache){.inode = inode, .offset = offset};
+    hash_insert(&page_cache_table, &page->page_cache.elem);
+    return page;
+}
+
+static uint64_t page_cache_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+    const struct page* page = hash_entry(e, struct page, page_cache.elem);
+    return hash_bytes(&page->page_cache.inode, sizeof page->page_cache.inode) ^ hash_int(page->page_cache.offset);
+}
+
+static bool page_cache_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED)
+{
+    const struct page_cache* a = &hash_entry(a_, struct page, page_cache.elem)->page_cache;
+    const struct page_cache* b = &hash_entry(b_, struct page, page_cache.elem)->page_cache;
+
+    if (a->inode != b->inode)
+        return a->inode < b->inode;
+    return a->offset < b->offset;
 }
+#endif /* EFILESYS */
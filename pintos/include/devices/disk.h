@@ -2,11 +2,18 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+#include "threads/synch.h"
 
 /* Size of a disk sector in bytes. */
 #define DISK_SECTOR_SIZE 512
 
+/* Maximum number of sectors transferred by one command. */
+#define DISK_MAX_SECTORS 256
+
 /* Index of a disk sector within a disk.
  * Good enough for disks up to 2 TB. */
 typedef uint32_t disk_sector_t;
@@ -15,6 +22,27 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+struct disk_request;
+
+/* Called when a disk request completes, from the disk interrupt
+ * handler. */
+typedef void disk_done_func(struct disk_request*);
+
+/* An asynchronous transfer between a disk and memory.  Set it up
+ * with disk_request_init(); only AUX is meant for the submitter
+ * after that. */
+struct disk_request {
+    struct disk* disk;         /* Disk to access. */
+    disk_sector_t sec_no;      /* First sector. */
+    size_t cnt;                /* Number of sectors. */
+    void* buffer;              /* Kernel buffer of CNT sectors. */
+    bool write;                /* Writes the disk if true, reads it otherwise. */
+    disk_done_func* done;      /* Completion function, or a null pointer. */
+    void* aux;                 /* For DONE. */
+    struct semaphore complete; /* Up'd on completion if DONE is null. */
+    struct list_elem elem;     /* Element in a channel's queue. */
+};
+
 void disk_init(void);
 void disk_print_stats(void);
 
@@ -22,6 +50,13 @@ struct disk* disk_get(int chan_no, int dev_no);
 disk_sector_t disk_size(struct disk*);
 void disk_read(struct disk*, disk_sector_t, void*);
 void disk_write(struct disk*, disk_sector_t, const void*);
+void disk_read_multi(struct disk*, disk_sector_t, size_t cnt, void*);
+void disk_write_multi(struct disk*, disk_sector_t, size_t cnt, const void*);
+
+void disk_request_init(struct disk_request*, struct disk*, disk_sector_t, size_t cnt, void* buffer, bool write,
+                       disk_done_func*, void* aux);
+void disk_submit(struct disk_request*);
+void disk_wait(struct disk_request*);
 
 void register_disk_inspect_intr();
 #endif /* devices/disk.h */
@@ -2,6 +2,7 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -18,6 +19,27 @@ void timer_msleep(int64_t milliseconds);
 void timer_usleep(int64_t microseconds);
 void timer_nsleep(int64_t nanoseconds);
 
+/* Kernel timer events.  An armed event calls FUNC (AUX) from the
+   timer interrupt handler once timer_ticks() reaches EXPIRES. */
+typedef void timer_callback(void* aux);
+
+struct timer_event {
+    int64_t expires;      /* Tick at which to fire. */
+    timer_callback* func; /* Called with interrupts off. */
+    void* aux;            /* Argument for FUNC. */
+    bool armed;           /* True while in the timer heap. */
+
+    /* Owned by timer.c. */
+    uint64_t seq;                /* Arming order, for ties. */
+    struct timer_event* child;   /* Leftmost child. */
+    struct timer_event* sibling; /* Next sibling. */
+    struct timer_event* prev;    /* Parent or previous sibling. */
+};
+
+void timer_event_init(struct timer_event*, timer_callback*, void* aux);
+void timer_arm(struct timer_event*, int64_t tick);
+bool timer_cancel(struct timer_event*);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
@@ -0,0 +1,15 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stddef.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+
+void buffer_cache_init(void);
+void buffer_cache_done(void);
+void buffer_cache_read(disk_sector_t, void*, off_t ofs, size_t size);
+void buffer_cache_write(disk_sector_t, const void*, off_t ofs, size_t size);
+void buffer_cache_readahead(disk_sector_t);
+void buffer_cache_flush(void);
+
+#endif /* filesys/buffer_cache.h */
@@ -6,6 +6,7 @@
 #include "devices/disk.h"
 
 struct bitmap;
+struct rwlock;
 
 void inode_init(void);
 bool inode_create(disk_sector_t, off_t);
@@ -18,6 +19,8 @@ off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
+bool inode_write_denied(const struct inode*);
+struct rwlock* inode_dir_lock(struct inode*);
 off_t inode_length(const struct inode*);
 
 #endif /* filesys/inode.h */
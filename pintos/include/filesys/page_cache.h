@@ -1,12 +1,30 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <stdbool.h>
+#include "hash.h"
+#include "filesys/off_t.h"
+
+struct inode;
 
-struct page;
-enum vm_type;
+/* A page of file data cached in the frame table. It belongs to no
+ * thread, so the accessed and dirty bits are kept in software. */
+struct page_cache {
+    struct inode* inode;   /* Cached file. */
+    off_t offset;          /* Page-aligned offset within INODE. */
+    bool accessed;         /* Referenced since the clock last looked. */
+    bool dirty;            /* Newer than the data on disk. */
+    struct hash_elem elem; /* Element in the page cache table. */
+};
 
-struct page_cache {};
+/* Included after struct page_cache, which struct page embeds. */
+#include "vm/vm.h"
 
-void page_cache_init(void);
+void pagecache_init(void);
 bool page_cache_initializer(struct page* page, enum vm_type type, void* kva);
+off_t page_cache_read(struct inode* inode, void* buffer, off_t size, off_t offset);
+off_t page_cache_write(struct inode* inode, const void* buffer, off_t size, off_t offset);
+bool page_cache_map(struct page* page);
+void page_cache_unmap(struct page* page);
+void page_cache_release_inode(struct inode* inode);
+void page_cache_flush(void);
 #endif
@@ -79,4 +79,18 @@ static inline long long get_fs_disk_write_cnt(void)
     return write_cnt;
 }
 
+static inline bool is_huge_page(void* user_addr)
+{
+    long long huge;
+    asm volatile("int $0x45" : "=a"(huge) : "a"(user_addr));
+    return huge != 0;
+}
+
+static inline long long get_used_frame_cnt(void)
+{
+    long long frame_cnt;
+    asm volatile("int $0x46" : "=a"(frame_cnt));
+    return frame_cnt;
+}
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,16 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Puts a newly carved object into its constructed state.  Runs
+   once per object, when its slab is created, not on every
+   kmem_cache_alloc(). */
+typedef void kmem_ctor(void* obj);
+
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor* ctor);
+void* kmem_cache_alloc(struct kmem_cache*);
+void kmem_cache_free(struct kmem_cache*, void*);
+void kmem_cache_print_stats(void);
+
+#endif /* threads/slab.h */
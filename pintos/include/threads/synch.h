@@ -3,6 +3,22 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* Ticket spinlock, for critical sections only a few instructions
+   long, such as a bitmap update.  Holding one keeps interrupts off,
+   so the holder must not sleep. */
+struct spinlock {
+    volatile uint32_t next;      /* Next ticket to hand out. */
+    volatile uint32_t owner;     /* Ticket now holding the lock. */
+    enum intr_level saved_level; /* Interrupt level before acquiring. */
+};
+
+void spinlock_init(struct spinlock*);
+void spinlock_acquire(struct spinlock*);
+void spinlock_release(struct spinlock*);
+bool spinlock_held(const struct spinlock*);
 
 /* A counting semaphore. */
 struct semaphore {
@@ -20,9 +36,18 @@ void sema_self_test(void);
 struct lock {
     struct thread* holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+
+    /* Statistics, updated by the holder. */
+    const char* name;             /* Set by lock_register(), or null. */
+    struct list_elem named_elem;  /* Element in the registered locks list. */
+    unsigned long long acquired;  /* Times acquired. */
+    unsigned long long contended; /* Times the acquirer had to wait. */
+    int64_t wait_ticks;           /* Timer ticks spent waiting. */
 };
 
 void lock_init(struct lock*);
+void lock_register(struct lock*, const char* name);
+void lock_print_stats(void);
 void lock_acquire(struct lock*);
 void donation_priority(void);
 bool lock_try_acquire(struct lock*);
@@ -40,6 +65,79 @@ void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
 
+/* Readers-writer lock, with writer preference.  A writer holds
+   LOCK for as long as it holds the rwlock, so every thread that
+   waits behind it, reader or writer, donates its priority to it
+   through the usual lock donation.  Readers hold LOCK only while
+   entering, so once a writer is waiting for the current readers
+   to leave, new readers queue behind it.  Readers themselves
+   receive no donation: there may be many of them. */
+struct rwlock {
+    struct lock lock;         /* Held by the writer. */
+    struct semaphore drained; /* Upped by the last reader to leave. */
+    unsigned readers;         /* Number of readers holding the lock. */
+    bool writer_waiting;      /* Writer is sleeping on DRAINED. */
+};
+
+void rwlock_init(struct rwlock*);
+void rwlock_acquire_read(struct rwlock*);
+void rwlock_release_read(struct rwlock*);
+void rwlock_acquire_write(struct rwlock*);
+void rwlock_release_write(struct rwlock*);
+bool rwlock_held_for_write(const struct rwlock*);
+
+/* Sequence lock, for small values that are read far more often
+   than they are written, such as the timer tick count.  Readers
+   neither block nor disable interrupts: they retry when a write
+   was in progress or completed while they read.  Writers must be
+   serialized by other means and must not be interrupted by a
+   reader, which would spin forever.
+
+   Reader:
+
+       do {
+           seq = seqlock_read_begin(&sl);
+           copy = value;
+       } while (seqlock_read_retry(&sl, seq)); */
+struct seqlock {
+    volatile unsigned seq; /* Odd while a write is in progress. */
+};
+
+static inline void seqlock_init(struct seqlock* sl)
+{
+    sl->seq = 0;
+}
+
+/* Starts a read, returning the sequence number to pass to
+   seqlock_read_retry(). */
+static inline unsigned seqlock_read_begin(const struct seqlock* sl)
+{
+    unsigned seq;
+
+    while ((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+        asm volatile("pause");
+    return seq;
+}
+
+/* Returns true if the values read since seqlock_read_begin()
+   returned SEQ may be torn and must be read again. */
+static inline bool seqlock_read_retry(const struct seqlock* sl, unsigned seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void seqlock_write_begin(struct seqlock* sl)
+{
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(struct seqlock* sl)
+{
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+}
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
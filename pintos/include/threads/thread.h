@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "devices/timer.h"
 #include "filesys/file.h"
 #ifdef VM
 #include "vm/vm.h"
@@ -108,7 +109,7 @@ struct thread {
     struct list_elem elem; /* List element. */
 
     /* Project 1 - Alarm Clock */
-    int64_t wake_time;
+    struct timer_event wakeup; /* Fires when timer_sleep() is over. */
 
     /* Project 1-3 - donation */
     int actual_priority;            /*donation 종료시 기존 priority로 돌아오기용*/
@@ -119,6 +120,9 @@ struct thread {
     /*project 1-4 - advenced*/
     int nice;
     int recent_cpu;
+    unsigned decay_epoch;          /* Second up to which recent_cpu is decayed. */
+    bool charged;                  /* In the charged list (thread.c). */
+    struct list_elem charged_elem; /* Charged list element. */
     /*~~project 2*/
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -168,7 +172,6 @@ void thread_preempted(void);
 
 /* Project 1 - Alarm Clock */
 void thread_sleep(int64_t tick);
-void thread_awake(int64_t ticks);
 /* ~Alarm Clock */
 
 struct thread* thread_current(void);
@@ -180,6 +183,7 @@ void thread_yield(void);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
+void thread_set_effective_priority(struct thread*, int);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
@@ -188,7 +192,7 @@ int thread_get_load_avg(void);
 
 /*project 1 -> Advanced scheduler*/
 void cal_priority(struct thread* t);
-void cal_recent_cpu(struct thread* t);
+void cal_recent_cpu(struct thread* t, int coef);
 void cal_load_avg(void);
 void update_priority(void);
 void incr_recent_cpu(void);
@@ -19,4 +19,19 @@ struct lazy_load_aux {
     size_t page_zero_bytes;
 };
 
+/* An executable segment that is loaded on demand. Every page of the
+ * segment that still has file data to read points to it; the page's
+ * part of the file follows from its address. */
+struct lazy_segment {
+    struct file* file;  /* Own handle on the executable. */
+    off_t ofs;          /* File offset of the segment's first page. */
+    uint8_t* upage;     /* User address of the segment's first page. */
+    size_t read_bytes;  /* Bytes read from the file; the rest is zero. */
+    int ref_cnt;        /* Pages that still point here. */
+};
+
+void lazy_segment_get(struct lazy_segment*);
+void lazy_segment_put(struct lazy_segment*);
+size_t lazy_segment_read_bytes(const struct lazy_segment*, const uint8_t* upage);
+
 #endif /* userprog/process.h */
@@ -4,7 +4,6 @@
 #include "filesys/file.h"
 
 void syscall_init(void);
-extern struct lock filesys_lock;
 
 typedef int pid_t;
 
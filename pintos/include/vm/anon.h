@@ -6,9 +6,13 @@ enum vm_type;
 
 struct anon_page {
     size_t slot_idx;
+    bool huge; /* Was mapped by a 2 MB page; see vm_try_collapse_huge(). */
 };
 
 void vm_anon_init(void);
 bool anon_initializer(struct page* page, enum vm_type type, void* kva);
+size_t anon_swap_out_shared(void* kva);
+void anon_share_slot(struct page* page, size_t slot_idx);
+void anon_put_slot(size_t slot_idx);
 
 #endif
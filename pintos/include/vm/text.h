@@ -0,0 +1,34 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+#include "filesys/off_t.h"
+
+struct page;
+struct file;
+struct lazy_segment;
+enum vm_type;
+
+/* A page of read-only executable text. A process's text page maps
+ * the frame of a holder: a page that belongs to no thread and caches
+ * one page of the executable for every process running it. */
+struct text_page {
+    /* Process pages. */
+    struct lazy_segment* seg; /* Segment the page belongs to. */
+    struct page* holder;      /* Cached copy, once looked up. */
+
+    /* Holders. */
+    struct file* file;     /* Own handle on the executable. */
+    off_t offset;          /* Page-aligned offset within FILE. */
+    size_t read_bytes;     /* Bytes of file data; the rest is zero. */
+    int users;             /* Process pages pointing here. */
+    bool accessed;         /* Mapped since the clock last looked. */
+    struct hash_elem elem; /* Element in the text cache. */
+};
+
+void vm_text_init(void);
+bool text_initializer(struct page* page, enum vm_type type, void* kva);
+bool text_map(struct page* page);
+void text_print_stats(void);
+#endif
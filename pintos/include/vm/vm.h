@@ -2,6 +2,7 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "hash.h"
 
 enum vm_type {
@@ -13,6 +14,8 @@ enum vm_type {
     VM_FILE = 2,
     /* page that hold the page cache, for project 4 */
     VM_PAGE_CACHE = 3,
+    /* read-only executable text, shared through the text cache */
+    VM_TEXT = 4,
 
     /* Bit flags to store state */
 
@@ -28,6 +31,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/text.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -50,24 +54,38 @@ struct page {
     struct hash_elem hash_elem;
     bool writable;
     struct thread* accessible_thread;
+    struct list_elem share_elem; /* Link in frame->sharers. */
     /* Per-type data are binded into the union.
      * Each function automatically detects the current union */
     union {
         struct uninit_page uninit;
         struct anon_page anon;
         struct file_page file;
+        struct text_page text;
 #ifdef EFILESYS
         struct page_cache page_cache;
 #endif
     };
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * Frames live in a preallocated table indexed by physical frame number
+ * within the user pool, so a kva maps to its frame in O(1).
+ * A frame may be mapped by several pages: copy-on-write after fork, or
+ * shared text and page cache pages together with their holder. SHARERS
+ * is the frame's reverse map; each page in it gives one mapping, at its
+ * VA in its owner's pml4. PAGE is any one of SHARERS.
+ * The free-frame stack is a list, not a singly linked stack, so that
+ * a 2 MB run of frames can be taken out of its middle. */
 struct frame {
     void* kva;
     struct page* page;
-    struct list_elem frame_elem;
-    bool in_table;
+    struct list_elem free_elem; /* Link in the free-frame stack. */
+    bool free;                  /* On the free-frame stack. */
+    bool pinned;                /* Being claimed or evicted; the clock skips it. */
+    bool evicting;              /* Its page is detached and being swapped out. */
+    int ref_cnt;                /* Number of pages mapping this frame. */
+    struct list sharers;        /* Reverse map: pages mapping this frame. */
 };
 
 /* The function table for page operations.
@@ -92,6 +110,7 @@ struct page_operations {
  * All designs up to you for this. */
 struct supplemental_page_table {
     struct hash hash_table;
+    struct rwlock lock; /* Lookups read, insertions and removals write. */
 };
 
 #include "threads/thread.h"
@@ -102,6 +121,13 @@ struct page* spt_find_page(struct supplemental_page_table* spt, void* va);
 bool spt_insert_page(struct supplemental_page_table* spt, struct page* page);
 void spt_remove_page(struct supplemental_page_table* spt, struct page* page);
 
+/* Where every `struct page' is allocated. */
+extern struct kmem_cache* page_slab;
+
+/* Page-out daemon watermarks, in free frames. */
+extern size_t vm_wm_low;
+extern size_t vm_wm_high;
+
 void vm_init(void);
 bool vm_try_handle_fault(struct intr_frame* f, void* addr, bool user, bool write, bool not_present);
 
@@ -110,6 +136,19 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void* upage, bool writabl
 void vm_dealloc_page(struct page* page);
 bool vm_claim_page(void* va);
 void vm_free_frame(struct frame* frame);
+void vm_release_frame(struct page* page);
+void vm_wait_eviction(struct page* page);
+struct frame* vm_get_free_frame(void);
+bool vm_map_frame(struct page* page, struct frame* frame);
+bool vm_map_prefetched(struct page* page, struct frame* frame);
+bool vm_isolate_page(struct page* page);
+void vm_unpin_frame(struct frame* frame);
+void vm_free_evicted_frame(struct frame* frame);
+bool vm_claim_kernel_page(struct page* page);
+bool vm_pin_page(struct page* page);
+bool vm_wait_page(struct page* page);
+void vm_wait_frame(struct frame* frame);
+bool vm_share_frame(struct page* holder, struct page* page);
 enum vm_type page_get_type(struct page* page);
 void hash_desroy_action(struct hash_elem* hash_elem, void* aux);
 
@@ -0,0 +1,61 @@
+/* Spawns 16 child processes, each of which reads its own file
+   a block at a time and checks the contents. The readers use
+   different files, so they should not wait for one another in
+   the file system. The time one reader takes alone and the time
+   all 16 take together are reported; with 16 times the bytes,
+   the second should be well under 16 times the first. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-read-lg.h"
+
+static char buf[FILE_SIZE];
+
+/* Returns the time stamp counter. The numbers depend on the host,
+   so they are only reported, never checked. */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Runs READER_CNT readers at once and reports how long they took
+   to read all of their files. */
+static void time_readers(size_t reader_cnt)
+{
+    pid_t children[CHILD_CNT];
+    uint64_t start = rdtsc();
+
+    exec_children("child-syn-read-lg", children, reader_cnt);
+    wait_children(children, reader_cnt);
+    msg("%zu reader(s), %zu bytes: %llu cycles", reader_cnt, reader_cnt * FILE_SIZE,
+        (unsigned long long)(rdtsc() - start));
+}
+
+void test_main(void)
+{
+    char file_name[16];
+    int fd;
+    int i;
+
+    quiet = true;
+    for (i = 0; i < CHILD_CNT; i++) {
+        snprintf(file_name, sizeof file_name, "data%d", i);
+        random_init(i);
+        random_bytes(buf, sizeof buf);
+        CHECK(create(file_name, 0), "create \"%s\"", file_name);
+        CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+        CHECK(write(fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", file_name);
+        close(fd);
+    }
+    quiet = false;
+    msg("created %d files", CHILD_CNT);
+
+    time_readers(1);
+    time_readers(CHILD_CNT);
+}
@@ -0,0 +1,63 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The numbers depend on the host, so only check that both
+# measurements were reported, and match the rest of the output.
+local ($_);
+my (%cycles, @rest);
+foreach (@output) {
+    if (/^\(syn-read-lg\) (\d+) reader\(s\), \d+ bytes: (\d+) cycles$/) {
+	$cycles{$1} = $2;
+    } else {
+	push (@rest, $_);
+    }
+}
+foreach my $readers (1, 16) {
+    fail "missing measurement for $readers reader(s)\n" if !defined $cycles{$readers};
+}
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@rest, [<<'EOF']);
+(syn-read-lg) begin
+(syn-read-lg) created 16 files
+(syn-read-lg) exec child 1 of 1: "child-syn-read-lg 0"
+(syn-read-lg) wait for child 1 of 1 returned 0 (expected 0)
+(syn-read-lg) exec child 1 of 16: "child-syn-read-lg 0"
+(syn-read-lg) exec child 2 of 16: "child-syn-read-lg 1"
+(syn-read-lg) exec child 3 of 16: "child-syn-read-lg 2"
+(syn-read-lg) exec child 4 of 16: "child-syn-read-lg 3"
+(syn-read-lg) exec child 5 of 16: "child-syn-read-lg 4"
+(syn-read-lg) exec child 6 of 16: "child-syn-read-lg 5"
+(syn-read-lg) exec child 7 of 16: "child-syn-read-lg 6"
+(syn-read-lg) exec child 8 of 16: "child-syn-read-lg 7"
+(syn-read-lg) exec child 9 of 16: "child-syn-read-lg 8"
+(syn-read-lg) exec child 10 of 16: "child-syn-read-lg 9"
+(syn-read-lg) exec child 11 of 16: "child-syn-read-lg 10"
+(syn-read-lg) exec child 12 of 16: "child-syn-read-lg 11"
+(syn-read-lg) exec child 13 of 16: "child-syn-read-lg 12"
+(syn-read-lg) exec child 14 of 16: "child-syn-read-lg 13"
+(syn-read-lg) exec child 15 of 16: "child-syn-read-lg 14"
+(syn-read-lg) exec child 16 of 16: "child-syn-read-lg 15"
+(syn-read-lg) wait for child 1 of 16 returned 0 (expected 0)
+(syn-read-lg) wait for child 2 of 16 returned 1 (expected 1)
+(syn-read-lg) wait for child 3 of 16 returned 2 (expected 2)
+(syn-read-lg) wait for child 4 of 16 returned 3 (expected 3)
+(syn-read-lg) wait for child 5 of 16 returned 4 (expected 4)
+(syn-read-lg) wait for child 6 of 16 returned 5 (expected 5)
+(syn-read-lg) wait for child 7 of 16 returned 6 (expected 6)
+(syn-read-lg) wait for child 8 of 16 returned 7 (expected 7)
+(syn-read-lg) wait for child 9 of 16 returned 8 (expected 8)
+(syn-read-lg) wait for child 10 of 16 returned 9 (expected 9)
+(syn-read-lg) wait for child 11 of 16 returned 10 (expected 10)
+(syn-read-lg) wait for child 12 of 16 returned 11 (expected 11)
+(syn-read-lg) wait for child 13 of 16 returned 12 (expected 12)
+(syn-read-lg) wait for child 14 of 16 returned 13 (expected 13)
+(syn-read-lg) wait for child 15 of 16 returned 14 (expected 14)
+(syn-read-lg) wait for child 16 of 16 returned 15 (expected 15)
+(syn-read-lg) end
+EOF
+pass;
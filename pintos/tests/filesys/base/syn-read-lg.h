@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_SYN_READ_LG_H
+#define TESTS_FILESYS_BASE_SYN_READ_LG_H
+
+#define CHILD_CNT 16
+#define FILE_SIZE 32768
+#define BLOCK_SIZE 512
+
+#endif /* tests/filesys/base/syn-read-lg.h */
@@ -0,0 +1,125 @@
+/* Puts 1000 threads to sleep with staggered wake-up times and
+   checks that the timer interrupt does not get slower with that
+   many sleepers: a busy loop must make about as much progress per
+   tick as it does with no sleepers at all.  Then verifies that
+   every sleeper wakes up on time and in order. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 1000
+#define MEASURE_TICKS 20
+
+/* Information about the test. */
+struct stress_test {
+    int64_t start;   /* Sleepers wake up after START. */
+    int64_t* output; /* Wake-up targets, in wake-up order. */
+    int output_cnt;  /* Number of entries in OUTPUT. */
+    int early_cnt;   /* Number of sleepers that woke too early. */
+    struct semaphore done;
+};
+
+/* Information about one sleeper. */
+struct sleeper_info {
+    struct stress_test* test;
+    int64_t target; /* Tick to sleep until. */
+};
+
+static thread_func sleeper;
+static unsigned spin_per_tick(void);
+
+void test_alarm_stress(void)
+{
+    struct stress_test test;
+    struct sleeper_info* info;
+    unsigned base, loaded;
+    int i;
+
+    /* This test does not work with the MLFQS. */
+    ASSERT(!thread_mlfqs);
+
+    test.output = malloc(sizeof *test.output * THREAD_CNT);
+    info = malloc(sizeof *info * THREAD_CNT);
+    if (test.output == NULL || info == NULL)
+        PANIC("couldn't allocate memory for test");
+    test.output_cnt = 0;
+    test.early_cnt = 0;
+    sema_init(&test.done, 0);
+
+    base = spin_per_tick();
+
+    /* Sleepers run at a higher priority, so each one goes to sleep
+       before thread_create() returns. */
+    msg("Putting %d threads to sleep.", THREAD_CNT);
+    test.start = timer_ticks() + 5 * TIMER_FREQ;
+    for (i = 0; i < THREAD_CNT; i++) {
+        char name[16];
+
+        /* Targets are spread over 300 ticks, not in creation order. */
+        info[i].test = &test;
+        info[i].target = test.start + (i * 7) % 300;
+        snprintf(name, sizeof name, "sleeper %d", i);
+        if (thread_create(name, PRI_DEFAULT + 1, sleeper, &info[i]) == TID_ERROR)
+            fail("couldn't create thread %d", i);
+    }
+
+    loaded = spin_per_tick();
+    msg("Measured the busy loop with %d sleepers.", THREAD_CNT);
+    if (loaded < base / 2)
+        fail("busy loop slowed from %u to %u iterations per tick", base, loaded);
+
+    for (i = 0; i < THREAD_CNT; i++)
+        sema_down(&test.done);
+
+    if (test.early_cnt != 0)
+        fail("%d threads woke up early", test.early_cnt);
+    for (i = 1; i < test.output_cnt; i++)
+        if (test.output[i] < test.output[i - 1])
+            fail("thread due at tick %" PRId64 " woke up after thread due at tick %" PRId64, test.output[i] - test.start,
+                 test.output[i - 1] - test.start);
+    msg("All %d threads woke up on time, in order.", test.output_cnt);
+
+    free(info);
+    free(test.output);
+}
+
+/* Returns the average number of busy loop iterations completed per
+   tick over MEASURE_TICKS ticks. */
+static unsigned spin_per_tick(void)
+{
+    unsigned loops = 0;
+    int64_t start = timer_ticks();
+
+    /* Start at the beginning of a tick. */
+    while (timer_ticks() == start)
+        continue;
+    start = timer_ticks();
+    while (timer_elapsed(start) < MEASURE_TICKS)
+        loops++;
+    return loops / MEASURE_TICKS;
+}
+
+/* Sleeper thread. */
+static void sleeper(void* info_)
+{
+    struct sleeper_info* info = info_;
+    struct stress_test* test = info->test;
+    enum intr_level old_level;
+
+    timer_sleep(info->target - timer_ticks());
+
+    old_level = intr_disable();
+    if (timer_ticks() < info->target)
+        test->early_cnt++;
+    test->output[test->output_cnt++] = info->target;
+    intr_set_level(old_level);
+
+    sema_up(&test->done);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-stress) begin
+(alarm-stress) Putting 1000 threads to sleep.
+(alarm-stress) Measured the busy loop with 1000 sleepers.
+(alarm-stress) All 1000 threads woke up on time, in order.
+(alarm-stress) end
+EOF
+pass;
@@ -0,0 +1,88 @@
+/* Measures how many malloc()/free() pairs the kernel allocator
+   completes per timer tick, first with the malloc magazines
+   turned off, so that every call takes the descriptor lock, and
+   then with them on.  Two workloads are run each way: a single
+   block allocated and freed over and over, and batches of blocks
+   of mixed sizes allocated and then freed in reverse order, the
+   pattern of a page fault or a system call that allocates a few
+   structures.
+
+   The numbers are reported, not checked: they depend on the
+   host. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+#define MEASURE_TICKS 50
+#define BATCH 48
+
+static unsigned bench_pairs(void);
+static unsigned bench_batches(void);
+
+void test_malloc_bench(void)
+{
+    unsigned pairs, batches;
+
+    malloc_use_magazines = false;
+    pairs = bench_pairs();
+    batches = bench_batches();
+    msg("Without magazines: %u pairs per tick, %u batched allocations per tick.", pairs, batches);
+
+    malloc_use_magazines = true;
+    pairs = bench_pairs();
+    batches = bench_batches();
+    msg("With magazines: %u pairs per tick, %u batched allocations per tick.", pairs, batches);
+}
+
+/* Waits for the start of a tick and returns it. */
+static int64_t start_tick(void)
+{
+    int64_t start = timer_ticks();
+
+    while (timer_ticks() == start)
+        continue;
+    return timer_ticks();
+}
+
+/* Returns the number of malloc(64)/free() pairs completed per
+   tick over MEASURE_TICKS ticks. */
+static unsigned bench_pairs(void)
+{
+    unsigned cnt = 0;
+    int64_t start = start_tick();
+
+    while (timer_elapsed(start) < MEASURE_TICKS) {
+        void* p = malloc(64);
+        if (p == NULL)
+            fail("malloc failed");
+        free(p);
+        cnt++;
+    }
+    return cnt / MEASURE_TICKS;
+}
+
+/* Returns the number of allocations completed per tick over
+   MEASURE_TICKS ticks, in batches of BATCH blocks of 16 to 512
+   bytes, each batch freed in reverse order. */
+static unsigned bench_batches(void)
+{
+    static void* blocks[BATCH];
+    unsigned cnt = 0;
+    int64_t start = start_tick();
+    int i;
+
+    while (timer_elapsed(start) < MEASURE_TICKS) {
+        for (i = 0; i < BATCH; i++) {
+            blocks[i] = malloc(16 << (i % 6));
+            if (blocks[i] == NULL)
+                fail("malloc failed");
+        }
+        for (i = BATCH - 1; i >= 0; i--)
+            free(blocks[i]);
+        cnt += BATCH;
+    }
+    return cnt / MEASURE_TICKS;
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# The numbers depend on the host, so only check that both
+# measurements were reported.
+local ($_);
+my (%seen);
+foreach (@output) {
+    my ($mode) = /^\(malloc-bench\) (Without|With) magazines: \d+ pairs per tick, \d+ batched allocations per tick\.$/
+      or next;
+    $seen{$mode} = 1;
+}
+fail "missing measurement without magazines\n" if !$seen{'Without'};
+fail "missing measurement with magazines\n" if !$seen{'With'};
+pass;
@@ -0,0 +1,116 @@
+/* Checks that the advanced scheduler's bookkeeping in the timer
+   interrupt does not grow with the number of threads.
+
+   The main thread measures how far a busy loop gets during the
+   slowest tick of a 2-second window, which includes the ticks on
+   which priorities and recent_cpu are recomputed.  It then puts
+   500 threads to sleep, half on the alarm clock and half on a
+   semaphore, and measures again.  The slowest tick must not get
+   much slower.  Finally, it wakes every thread and waits for all
+   of them to finish. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 500
+#define MEASURE_TICKS (2 * TIMER_FREQ)
+
+/* Information about the test. */
+struct tick_test {
+    int64_t wake_time;       /* When the alarm clock sleepers wake. */
+    struct semaphore block;  /* Where the other sleepers block. */
+    struct semaphore asleep; /* Upped by each thread before it sleeps. */
+    struct semaphore done;   /* Upped by each thread when it wakes. */
+};
+
+static thread_func alarm_sleeper, sema_sleeper;
+static unsigned slowest_tick(void);
+
+void test_mlfqs_tick_500(void)
+{
+    struct tick_test test;
+    unsigned base, loaded;
+    int i;
+
+    ASSERT(thread_mlfqs);
+
+    sema_init(&test.block, 0);
+    sema_init(&test.asleep, 0);
+    sema_init(&test.done, 0);
+
+    base = slowest_tick();
+
+    msg("Putting %d threads to sleep.", THREAD_CNT);
+    test.wake_time = timer_ticks() + 10 * TIMER_FREQ;
+    for (i = 0; i < THREAD_CNT; i++) {
+        char name[16];
+        snprintf(name, sizeof name, "sleeper %d", i);
+        if (thread_create(name, PRI_DEFAULT, i % 2 ? alarm_sleeper : sema_sleeper, &test) == TID_ERROR)
+            fail("couldn't create thread %d", i);
+    }
+    for (i = 0; i < THREAD_CNT; i++)
+        sema_down(&test.asleep);
+    /* Let the last threads get from sema_up() to sleeping. */
+    timer_sleep(TIMER_FREQ / 10);
+
+    loaded = slowest_tick();
+    msg("Measured the slowest tick with %d sleepers.", THREAD_CNT);
+    if (loaded < base / 2)
+        fail("slowest tick went from %u to %u busy loop iterations", base, loaded);
+
+    msg("Waking up all threads.");
+    for (i = 0; i < THREAD_CNT / 2; i++)
+        sema_up(&test.block);
+    for (i = 0; i < THREAD_CNT; i++)
+        sema_down(&test.done);
+    msg("All %d threads woke up.", THREAD_CNT);
+}
+
+/* Returns the fewest busy loop iterations completed during any
+   single tick over MEASURE_TICKS ticks. */
+static unsigned slowest_tick(void)
+{
+    unsigned slowest = UINT32_MAX;
+    int64_t start = timer_ticks();
+    int64_t now;
+    int i;
+
+    /* Start at the beginning of a tick. */
+    while ((now = timer_ticks()) == start)
+        continue;
+
+    for (i = 0; i < MEASURE_TICKS; i++) {
+        int64_t tick = now;
+        unsigned loops = 0;
+
+        while ((now = timer_ticks()) == tick)
+            loops++;
+        if (loops < slowest)
+            slowest = loops;
+    }
+    return slowest;
+}
+
+/* Sleeps on the alarm clock. */
+static void alarm_sleeper(void* test_)
+{
+    struct tick_test* test = test_;
+
+    sema_up(&test->asleep);
+    timer_sleep(test->wake_time - timer_ticks());
+    sema_up(&test->done);
+}
+
+/* Blocks on a semaphore. */
+static void sema_sleeper(void* test_)
+{
+    struct tick_test* test = test_;
+
+    sema_up(&test->asleep);
+    sema_down(&test->block);
+    sema_up(&test->done);
+}
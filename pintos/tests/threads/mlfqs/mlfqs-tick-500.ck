@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mlfqs-tick-500) begin
+(mlfqs-tick-500) Putting 500 threads to sleep.
+(mlfqs-tick-500) Measured the slowest tick with 500 sleepers.
+(mlfqs-tick-500) Waking up all threads.
+(mlfqs-tick-500) All 500 threads woke up.
+(mlfqs-tick-500) end
+EOF
+pass;
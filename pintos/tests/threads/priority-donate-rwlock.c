@@ -0,0 +1,67 @@
+/* Checks the readers-writer lock's writer preference and its
+   priority donation.
+
+   The main thread takes the rwlock for reading.  A writer at a
+   higher priority then blocks waiting for the main thread to
+   leave, and a reader at a higher priority still arrives after
+   it.  The reader must not overtake the waiting writer, even
+   though the rwlock is only held for reading.
+
+   Then the main thread takes the rwlock for writing, and a reader
+   and a writer at higher priorities block on it.  Both must
+   donate their priority to the main thread. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+
+void test_priority_donate_rwlock(void)
+{
+    struct rwlock rwlock;
+
+    /* This test does not work with the MLFQS. */
+    ASSERT(!thread_mlfqs);
+
+    /* Make sure our priority is the default. */
+    ASSERT(thread_get_priority() == PRI_DEFAULT);
+
+    rwlock_init(&rwlock);
+    rwlock_acquire_read(&rwlock);
+    thread_create("writer", PRI_DEFAULT + 1, writer_thread_func, &rwlock);
+    thread_create("reader", PRI_DEFAULT + 2, reader_thread_func, &rwlock);
+    msg("Releasing the read lock.");
+    rwlock_release_read(&rwlock);
+    msg("writer, reader must already have finished, in that order.");
+
+    rwlock_acquire_write(&rwlock);
+    thread_create("reader", PRI_DEFAULT + 1, reader_thread_func, &rwlock);
+    msg("This thread should have priority %d.  Actual priority: %d.", PRI_DEFAULT + 1, thread_get_priority());
+    thread_create("writer", PRI_DEFAULT + 2, writer_thread_func, &rwlock);
+    msg("This thread should have priority %d.  Actual priority: %d.", PRI_DEFAULT + 2, thread_get_priority());
+    rwlock_release_write(&rwlock);
+    msg("writer, reader must already have finished, in that order.");
+    msg("This thread should have priority %d.  Actual priority: %d.", PRI_DEFAULT, thread_get_priority());
+}
+
+static void reader_thread_func(void* rwlock_)
+{
+    struct rwlock* rwlock = rwlock_;
+
+    rwlock_acquire_read(rwlock);
+    msg("reader: got the lock");
+    rwlock_release_read(rwlock);
+}
+
+static void writer_thread_func(void* rwlock_)
+{
+    struct rwlock* rwlock = rwlock_;
+
+    rwlock_acquire_write(rwlock);
+    msg("writer: got the lock");
+    rwlock_release_write(rwlock);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-rwlock) begin
+(priority-donate-rwlock) Releasing the read lock.
+(priority-donate-rwlock) writer: got the lock
+(priority-donate-rwlock) reader: got the lock
+(priority-donate-rwlock) writer, reader must already have finished, in that order.
+(priority-donate-rwlock) This thread should have priority 32.  Actual priority: 32.
+(priority-donate-rwlock) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-rwlock) writer: got the lock
+(priority-donate-rwlock) reader: got the lock
+(priority-donate-rwlock) writer, reader must already have finished, in that order.
+(priority-donate-rwlock) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-rwlock) end
+EOF
+pass;
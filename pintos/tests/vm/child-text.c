@@ -0,0 +1,50 @@
+/* Child process of text-share.
+   Reads through LARGE, 2 MB of read-only data that the linker puts
+   into the text segment along with the code, so that every page of
+   the segment is faulted in.  Copy I then starts copy I + 1 and
+   waits for it, so that all of them are alive when the last one
+   reports the frames in use. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/vm/text-share.h"
+
+#define PAGE_SIZE 4096
+
+static const
+#include "tests/vm/large.inc"
+
+int main(int argc, char* argv[])
+{
+    char cmd_line[32];
+    pid_t child;
+    int idx;
+
+    test_name = "child-text";
+
+    CHECK(argc == 2, "argc must be 2, actually %d", argc);
+    idx = atoi(argv[1]);
+
+    if (memcmp(large, "Lorem ipsum", 11))
+        fail("text segment has wrong contents");
+    if (strlen(large) != sizeof large - 1)
+        fail("text segment has wrong length");
+
+    if (idx + 1 < CHILD_CNT) {
+        snprintf(cmd_line, sizeof cmd_line, "child-text %d", idx + 1);
+        child = fork("child-text");
+        if (child == 0) {
+            if (exec(cmd_line) == -1)
+                fail("failed to exec child-text");
+        }
+        if (wait(child) != 0x42)
+            fail("copy %d of child-text failed", idx + 1);
+    } else {
+        msg("%d copies running, text segment of %zu pages", CHILD_CNT, sizeof large / PAGE_SIZE);
+        msg("frames in use: %lld", get_used_frame_cnt());
+    }
+    return 0x42;
+}
@@ -0,0 +1,108 @@
+/* Forks many times from a process with a small and then a large
+   resident set and reports the average fork latency for both.
+   With copy-on-write, each fork only shares the parent's frames,
+   so fork latency does not follow the resident set size the way
+   copying it would; the cost of copying the large resident set
+   once is reported for comparison.  The children also check that
+   they see the parent's physical pages until they write. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BUF_SIZE (2 * 1024 * 1024)
+#define SMALL_PAGES 16
+#define FORK_CNT 64
+
+static char buf[BUF_SIZE];
+static char copy[BUF_SIZE];
+static size_t touched; /* Pages of BUF the parent has written. */
+static void* parent_pa[BUF_SIZE / PAGE_SIZE]; /* Their physical pages. */
+
+/* Returns the time stamp counter. The numbers depend on the host,
+   so they are only reported, never checked. */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Returns 0 if the child sees the parent's data in the parent's
+   physical pages and gets its own copy of the one page it writes,
+   otherwise the number of the first check that failed. */
+static int child(void)
+{
+    size_t i;
+
+    for (i = 0; i < touched; i++) {
+        if (buf[i * PAGE_SIZE] != (char)i)
+            return 1;
+        if (get_phys_addr(buf + i * PAGE_SIZE) != parent_pa[i])
+            return 2;
+    }
+
+    /* Dirty one page: only that page may be copied. */
+    buf[0] = '@';
+    if (buf[0] != '@' || get_phys_addr(buf) == parent_pa[0])
+        return 3;
+    if (touched > 1 && get_phys_addr(buf + PAGE_SIZE) != parent_pa[1])
+        return 4;
+    return 0;
+}
+
+/* Touches the first PAGES pages of BUF, then forks FORK_CNT times
+   and returns the average number of cycles fork() took. */
+static uint64_t time_forks(size_t pages)
+{
+    uint64_t total = 0;
+    size_t i;
+    int f;
+
+    for (; touched < pages; touched++)
+        buf[touched * PAGE_SIZE] = (char)touched;
+    for (i = 0; i < touched; i++)
+        parent_pa[i] = get_phys_addr(buf + i * PAGE_SIZE);
+    msg("touched %zu pages", touched);
+
+    for (f = 0; f < FORK_CNT; f++) {
+        uint64_t start = rdtsc();
+        pid_t pid = fork("child");
+        if (pid == 0)
+            exit(child());
+        total += rdtsc() - start;
+        int status = wait(pid);
+        if (status != 0)
+            fail("child %d failed check %d", f, status);
+    }
+    msg("forked %d children", FORK_CNT);
+    return total / FORK_CNT;
+}
+
+void test_main(void)
+{
+    uint64_t small, large, start;
+    void* pa_first;
+    size_t i;
+
+    small = time_forks(SMALL_PAGES);
+    pa_first = get_phys_addr(buf);
+    large = time_forks(BUF_SIZE / PAGE_SIZE);
+    msg("fork with %d resident pages: %llu cycles", SMALL_PAGES, small);
+    msg("fork with %d resident pages: %llu cycles", BUF_SIZE / PAGE_SIZE, large);
+
+    /* 처음 복사는 COPY의 page fault까지 포함하므로 두 번째만 잼 */
+    memcpy(copy, buf, BUF_SIZE);
+    start = rdtsc();
+    memcpy(copy, buf, BUF_SIZE);
+    msg("copy of %d pages: %llu cycles", BUF_SIZE / PAGE_SIZE, rdtsc() - start);
+
+    for (i = 0; i < BUF_SIZE; i += PAGE_SIZE)
+        if (buf[i] != (char)(i / PAGE_SIZE))
+            fail("parent memory changed at page %zu", i / PAGE_SIZE);
+    CHECK(pa_first == get_phys_addr(buf), "parent keeps its physical page");
+}
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The numbers depend on the host, so only check that every
+# measurement was reported, and match the rest of the output.
+local ($_);
+my (%cycles, @rest);
+foreach (@output) {
+    if (/^\(cow-fork-many\) (.*): (\d+) cycles$/) {
+	$cycles{$1} = $2;
+    } else {
+	push (@rest, $_);
+    }
+}
+foreach my $what ("fork with 16 resident pages", "fork with 512 resident pages", "copy of 512 pages") {
+    fail "missing measurement: $what\n" if !defined $cycles{$what};
+}
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@rest, [<<'EOF']);
+(cow-fork-many) begin
+(cow-fork-many) touched 16 pages
+(cow-fork-many) forked 64 children
+(cow-fork-many) touched 512 pages
+(cow-fork-many) forked 64 children
+(cow-fork-many) parent keeps its physical page
+(cow-fork-many) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Forks, then has the child read() a file into a buffer it still
+   shares with its parent.  The kernel writes the data, not the
+   child, so the write must still break copy-on-write: the parent's
+   copy of the buffer has to stay as it was. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BUF_SIZE (2 * 4096)
+
+static char buf[BUF_SIZE];
+static char data[BUF_SIZE];
+
+void test_main(void)
+{
+    pid_t child;
+    void* pa_parent;
+    size_t i;
+    int fd;
+
+    memset(data, 'c', sizeof data);
+    CHECK(create("cow-read.dat", sizeof data), "create \"cow-read.dat\"");
+    CHECK((fd = open("cow-read.dat")) > 1, "open \"cow-read.dat\"");
+    CHECK(write(fd, data, sizeof data) == sizeof data, "write \"cow-read.dat\"");
+    close(fd);
+
+    memset(buf, 'p', sizeof buf);
+    pa_parent = get_phys_addr(buf);
+
+    child = fork("child");
+    if (child == 0) {
+        CHECK(pa_parent == get_phys_addr(buf), "child shares the parent's page");
+        CHECK((fd = open("cow-read.dat")) > 1, "open \"cow-read.dat\"");
+        CHECK(read(fd, buf, sizeof buf) == sizeof buf, "read \"cow-read.dat\"");
+        close(fd);
+        CHECK(memcmp(buf, data, sizeof buf) == 0, "child sees the data it read");
+        CHECK(pa_parent != get_phys_addr(buf), "child has its own page");
+        return;
+    }
+    CHECK(wait(child) == 0, "wait for child");
+    CHECK(pa_parent == get_phys_addr(buf), "parent keeps its physical page");
+    for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != 'p')
+            fail("parent's buffer changed at byte %zu", i);
+    msg("parent's buffer is unchanged");
+}
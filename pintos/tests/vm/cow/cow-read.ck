@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-read) begin
+(cow-read) create "cow-read.dat"
+(cow-read) open "cow-read.dat"
+(cow-read) write "cow-read.dat"
+(cow-read) child shares the parent's page
+(cow-read) open "cow-read.dat"
+(cow-read) read "cow-read.dat"
+(cow-read) child sees the data it read
+(cow-read) child has its own page
+(cow-read) end
+(cow-read) wait for child
+(cow-read) parent keeps its physical page
+(cow-read) parent's buffer is unchanged
+(cow-read) end
+EOF
+pass;
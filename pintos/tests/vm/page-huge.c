@@ -0,0 +1,87 @@
+/* Touches one byte in each page of 64 MB of memory, over and over,
+   first while the buffer is mapped by 2 MB pages and then, after a
+   fork has split them, while it is mapped by 4 kB pages, and reports
+   the cycles a pass takes each way.  Nearly every access needs a TLB
+   entry of its own with 4 kB pages, while 32 entries cover the
+   buffer with 2 MB pages.  Finally verifies the contents. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024 * 1024)
+#define PAGE 4096
+#define PASSES 8
+
+static char buf[SIZE];
+
+/* Returns the time stamp counter. The numbers depend on the host,
+   so they are only reported, never checked. */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Increments one byte in each page of BUF. */
+static void strided_pass(void)
+{
+    size_t i;
+
+    for (i = 0; i < SIZE; i += PAGE)
+        buf[i]++;
+}
+
+/* Runs PASSES strided passes and returns the average number of
+   cycles one took. */
+static uint64_t time_passes(void)
+{
+    uint64_t start = rdtsc();
+    int pass;
+
+    for (pass = 0; pass < PASSES; pass++)
+        strided_pass();
+    return (rdtsc() - start) / PASSES;
+}
+
+void test_main(void)
+{
+    char* mid = buf + SIZE / 2;
+    uint64_t huge, small;
+    size_t i;
+    pid_t pid;
+
+    /* Fault in the whole buffer. */
+    msg("first touch pass");
+    strided_pass();
+    CHECK(is_huge_page(mid), "buffer is mapped by 2 MB pages");
+
+    msg("strided passes with 2 MB pages");
+    huge = time_passes();
+
+    /* Sharing the buffer with a child splits the 2 MB pages, and
+       nothing maps them by 2 MB pages again while they stay
+       resident. */
+    pid = fork("child");
+    if (pid == 0)
+        exit(0);
+    CHECK(wait(pid) == 0, "wait for child");
+    CHECK(!is_huge_page(mid), "buffer is mapped by 4 kB pages");
+
+    /* The first writes after the fork only restore write access. */
+    strided_pass();
+    msg("strided passes with 4 kB pages");
+    small = time_passes();
+
+    msg("2 MB pages: %llu cycles per pass", huge);
+    msg("4 kB pages: %llu cycles per pass", small);
+
+    /* Check the touched bytes and that the others are still zero. */
+    msg("read pass");
+    for (i = 0; i < SIZE; i++)
+        if (buf[i] != (i % PAGE == 0 ? 2 + 2 * PASSES : 0))
+            fail("byte %zu is %d", i, buf[i]);
+}
@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The numbers depend on the host, so only check that both
+# measurements were reported, and match the rest of the output.
+local ($_);
+my (%cycles, @rest);
+foreach (@output) {
+    if (/^\(page-huge\) (.*): (\d+) cycles per pass$/) {
+	$cycles{$1} = $2;
+    } else {
+	push (@rest, $_);
+    }
+}
+foreach my $what ("2 MB pages", "4 kB pages") {
+    fail "missing measurement: $what\n" if !defined $cycles{$what};
+}
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@rest, [<<'EOF']);
+(page-huge) begin
+(page-huge) first touch pass
+(page-huge) buffer is mapped by 2 MB pages
+(page-huge) strided passes with 2 MB pages
+(page-huge) wait for child
+(page-huge) buffer is mapped by 4 kB pages
+(page-huge) strided passes with 4 kB pages
+(page-huge) read pass
+(page-huge) end
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Runs 20 copies of child-text at once: each copy starts the next
+   one and waits for it, and the last reports how many frames are in
+   use while all of them are alive.  Their 2 MB text segment fits in
+   memory once, but not 20 times, so the copies must share it; then
+   the frames in use grow by about one copy of the text rather than
+   20. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/text-share.h"
+
+void test_main(void)
+{
+    pid_t child;
+
+    msg("frames in use before: %lld", get_used_frame_cnt());
+    child = fork("child-text");
+    if (child == 0) {
+        if (exec("child-text 0") == -1)
+            fail("failed to exec child-text");
+    }
+    CHECK(wait(child) == 0x42, "wait for %d copies of child-text", CHILD_CNT);
+}
@@ -0,0 +1,52 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The frame counts depend on the kernel's memory layout, so pull them
+# out of the output and check only how they relate.
+local ($_);
+my ($before, $after, $copies, $text_pages, @rest);
+foreach (@output) {
+    if (/^\(text-share\) frames in use before: (\d+)$/) {
+	$before = $1;
+    } elsif (/^\(child-text\) (\d+) copies running, text segment of (\d+) pages$/) {
+	($copies, $text_pages) = ($1, $2);
+    } elsif (/^\(child-text\) frames in use: (\d+)$/) {
+	$after = $1;
+    } else {
+	push (@rest, $_);
+    }
+}
+fail "missing frame count before the copies started\n" if !defined $before;
+fail "missing frame count with all copies running\n"
+  if !defined $after || !defined $text_pages;
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@rest, [<<'EOF']);
+(text-share) begin
+(text-share) wait for 20 copies of child-text
+(text-share) end
+EOF
+
+# Without sharing, the copies would need COPIES * TEXT_PAGES frames for
+# their text alone.  With it, they should take one copy of the text
+# plus a few private pages each.
+my ($used) = $after - $before;
+my ($unshared) = $copies * $text_pages;
+fail "$copies copies use $used frames, expected fewer than "
+  . 2 * $text_pages . " ($unshared without sharing)\n"
+  if $used >= 2 * $text_pages;
+
+# Only the first copy should have to read the text: the others find it
+# in the text cache.
+my ($hits, $misses);
+foreach (@output) {
+    ($hits, $misses) = /^Text cache: \d+ pages, (\d+) hits, (\d+) misses$/ and last;
+}
+fail "missing text cache statistics\n" if !defined $hits;
+fail "$hits text cache hits for $misses misses, expected 10 times as many\n"
+  if $hits < 10 * $misses;
+pass;
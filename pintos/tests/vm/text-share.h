@@ -0,0 +1,7 @@
+#ifndef TESTS_VM_TEXT_SHARE_H
+#define TESTS_VM_TEXT_SHARE_H
+
+/* Number of copies of child-text that run at once. */
+#define CHILD_CNT 20
+
+#endif /* tests/vm/text-share.h */
@@ -1,24 +1,25 @@
-// 17.14 fixed-point number representation
-#define F (1 << 14)
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
 
-#ifndef int64_t
 #include <stdint.h>
-#endif
+
+// 17.14 fixed-point number representation
+#define F (1 << 14)
 
 // Convert n to fixed point
-int int_to_fp(int n)
+static inline int int_to_fp(int n)
 {
     return n * F;
 }
 
 // Convert x to integer (rounding toward zero)
-int fp_to_int_round_zero(int x)
+static inline int fp_to_int_round_zero(int x)
 {
     return x / F;
 }
 
 // Convert x to integer (rounding to nearest)
-int fp_to_int_round_near(int x)
+static inline int fp_to_int_round_near(int x)
 {
     if (x >= 0)
         return (x + F / 2) / F;
@@ -26,49 +27,64 @@ int fp_to_int_round_near(int x)
 }
 
 // Add x and y
-int add_fp(int x, int y)
+static inline int add_fp(int x, int y)
 {
     return x + y;
 }
 
 // Subtract y from x
-int sub_fp(int x, int y)
+static inline int sub_fp(int x, int y)
 {
     return x - y;
 }
 
 // Add x and n
-int add_fp_int(int x, int n)
+static inline int add_fp_int(int x, int n)
 {
     return x + n * F;
 }
 
 // Subtract n from x
-int sub_fp_int(int x, int n)
+static inline int sub_fp_int(int x, int n)
 {
     return x - n * F;
 }
 
 // Multiply x by y
-int mul_fp(int x, int y)
+static inline int mul_fp(int x, int y)
 {
     return ((int64_t)x) * y / F;
 }
 
 // Multiply x by n
-int mul_fp_int(int x, int n)
+static inline int mul_fp_int(int x, int n)
 {
     return x * n;
 }
 
 // Divide x by y
-int div_fp(int x, int y)
+static inline int div_fp(int x, int y)
 {
     return ((int64_t)x) * F / y;
 }
 
 // Divide x by n
-int div_fp_int(int x, int n)
+static inline int div_fp_int(int x, int n)
 {
     return x / n;
-}
\ No newline at end of file
+}
+
+// Raise x to the n-th power, by repeated squaring
+static inline int pow_fp(int x, unsigned n)
+{
+    int result = F;
+    while (n > 0) {
+        if (n & 1)
+            result = mul_fp(result, x);
+        x = mul_fp(x, x);
+        n >>= 1;
+    }
+    return result;
+}
+
+#endif /* threads/fixed-point.h */
@@ -20,6 +20,7 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -151,16 +152,26 @@ static void bss_init(void)
  * Points base_pml4 to the pml4 it creates. */
 static void paging_init(uint64_t mem_end)
 {
-    uint64_t *pml4, *pte;
+    uint64_t *pml4, *pte, *pde;
     int perm;
     pml4 = base_pml4 = palloc_get_page(PAL_ASSERT | PAL_ZERO);
 
     extern char start, _end_kernel_text;
     // Maps physical address [0 ~ mem_end] to
     //   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
+    // Whole 2 MB chunks are mapped as 2 MB pages, except the first
+    //   (BIOS and VGA memory) and those holding read-only kernel text.
     for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
         uint64_t va = (uint64_t)ptov(pa);
 
+        if (pa != 0 && (pa & HUGE_PGMASK) == 0 && pa + HUGE_PGSIZE <= mem_end &&
+            (va + HUGE_PGSIZE <= (uint64_t)&start || (uint64_t)&_end_kernel_text <= va)) {
+            if ((pde = pml4e_walk_pde(pml4, va, 1)) != NULL)
+                *pde = pa | PTE_PS | PTE_P | PTE_W;
+            pa += HUGE_PGSIZE - PGSIZE;
+            continue;
+        }
+
         perm = PTE_P | PTE_W;
         if ((uint64_t)&start <= va && va < (uint64_t)&_end_kernel_text)
             perm &= ~PTE_W;
@@ -232,6 +243,12 @@ static char** parse_options(char** argv)
             user_page_limit = atoi(value);
         else if (!strcmp(name, "-threads-tests"))
             thread_tests = true;
+#endif
+#ifdef VM
+        else if (!strcmp(name, "-wm-low"))
+            vm_wm_low = atoi(value);
+        else if (!strcmp(name, "-wm-high"))
+            vm_wm_high = atoi(value);
 #endif
         else
             PANIC("unknown option `%s' (use -h for help)", name);
@@ -329,6 +346,10 @@ static void usage(void)
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+           "  -wm-low=COUNT      Wake the page-out daemon below COUNT free frames.\n"
+           "  -wm-high=COUNT     Let the page-out daemon stop at COUNT free frames.\n"
 #endif
     );
     power_off();
@@ -365,6 +386,8 @@ static void print_stats(void)
 {
     timer_print_stats();
     thread_print_stats();
+    lock_print_stats();
+    kmem_cache_print_stats();
 #ifdef FILESYS
     disk_print_stats();
 #endif
@@ -373,4 +396,7 @@ static void print_stats(void)
 #ifdef USERPROG
     exception_print_stats();
 #endif
+#ifdef VM
+    text_print_stats();
+#endif
 }
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -28,20 +29,45 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
+   In front of each free list sits a "magazine", a
+   small stack of free blocks that malloc() and free() use with
+   interrupts off instead of taking the descriptor's lock.  Only
+   when a magazine runs empty or full do we take the lock, and
+   then we move half a magazine's worth of blocks at once, so a
+   thread that alternates malloc() and free() around the boundary
+   does not take the lock every time.  See [Bonwick01].
+
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
    the beginning of the allocated block's arena header. */
 
+/* Maximum number of blocks in a magazine. */
+#define MAG_ROUNDS 32
+
+/* A cache of free blocks for one descriptor.  Accessed only with
+   interrupts off. */
+struct magazine {
+    size_t cnt;                       /* Number of blocks in ROUNDS. */
+    struct block* rounds[MAG_ROUNDS]; /* Free blocks, used as a stack. */
+};
+
 /* Descriptor. */
 struct desc {
     size_t block_size;       /* Size of each element in bytes. */
     size_t blocks_per_arena; /* Number of blocks in an arena. */
     struct list free_list;   /* List of free blocks. */
     struct lock lock;        /* Lock. */
+    char name[16];           /* Lock name, "malloc N". */
+    size_t mag_size;         /* Capacity of the magazine. */
+    struct magazine mag;     /* Free blocks in front of FREE_LIST. */
 };
 
+/* If false, malloc() and free() bypass the magazines and always
+   go to the descriptor's free list. */
+bool malloc_use_magazines = true;
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -63,6 +89,8 @@ static size_t desc_cnt;       /* Number of descriptors. */
 
 static struct arena* block_to_arena(struct block*);
 static struct block* arena_to_block(struct arena*, size_t idx);
+static struct block* desc_alloc(struct desc*);
+static void desc_free(struct desc*, struct block*);
 
 /* Initializes the malloc() descriptors. */
 void malloc_init(void)
@@ -74,8 +102,11 @@ void malloc_init(void)
         ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
         d->block_size = block_size;
         d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
+        d->mag_size = d->blocks_per_arena < MAG_ROUNDS ? d->blocks_per_arena : MAG_ROUNDS;
         list_init(&d->free_list);
         lock_init(&d->lock);
+        snprintf(d->name, sizeof d->name, "malloc %zu", block_size);
+        lock_register(&d->lock, d->name);
     }
 }
 
@@ -86,6 +117,8 @@ void* malloc(size_t size)
     struct desc* d;
     struct block* b;
     struct arena* a;
+    struct magazine* mag;
+    enum intr_level old_level;
 
     /* A null pointer satisfies a request for 0 bytes. */
     if (size == 0)
@@ -112,7 +145,42 @@ void* malloc(size_t size)
         return a + 1;
     }
 
+    /* Take a block from the magazine, if it has one. */
+    old_level = intr_disable();
+    mag = &d->mag;
+    if (malloc_use_magazines && mag->cnt > 0) {
+        b = mag->rounds[--mag->cnt];
+        intr_set_level(old_level);
+        return b;
+    }
+    intr_set_level(old_level);
+
     lock_acquire(&d->lock);
+    b = desc_alloc(d);
+    if (b != NULL && malloc_use_magazines) {
+        /* Refill the magazine halfway while we hold the lock. */
+        old_level = intr_disable();
+        mag = &d->mag;
+        while (mag->cnt < d->mag_size / 2 && !list_empty(&d->free_list)) {
+            struct block* round = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
+            block_to_arena(round)->free_cnt--;
+            mag->rounds[mag->cnt++] = round;
+        }
+        intr_set_level(old_level);
+    }
+    lock_release(&d->lock);
+    return b;
+}
+
+/* Takes a block off D's free list, creating a new arena if the
+   list is empty.  Returns a null pointer if memory is not
+   available.  D's lock must be held. */
+static struct block* desc_alloc(struct desc* d)
+{
+    struct block* b;
+    struct arena* a;
+
+    ASSERT(lock_held_by_current_thread(&d->lock));
 
     /* If the free list is empty, create a new arena. */
     if (list_empty(&d->free_list)) {
@@ -120,10 +188,8 @@ void* malloc(size_t size)
 
         /* Allocate a page. */
         a = palloc_get_page(0);
-        if (a == NULL) {
-            lock_release(&d->lock);
+        if (a == NULL)
             return NULL;
-        }
 
         /* Initialize arena and add its blocks to the free list. */
         a->magic = ARENA_MAGIC;
@@ -139,7 +205,6 @@ void* malloc(size_t size)
     b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
     a = block_to_arena(b);
     a->free_cnt--;
-    lock_release(&d->lock);
     return b;
 }
 
@@ -204,6 +269,10 @@ void free(void* p)
         struct block* b = p;
         struct arena* a = block_to_arena(b);
         struct desc* d = a->desc;
+        struct block* flush[(MAG_ROUNDS + 1) / 2];
+        size_t flush_cnt;
+        struct magazine* mag;
+        enum intr_level old_level;
 
         if (d != NULL) {
             /* It's a normal block.  We handle it here. */
@@ -213,23 +282,29 @@ void free(void* p)
             memset(b, 0xcc, d->block_size);
 #endif
 
-            lock_acquire(&d->lock);
-
-            /* Add block to free list. */
-            list_push_front(&d->free_list, &b->free_elem);
-
-            /* If the arena is now entirely unused, free it. */
-            if (++a->free_cnt >= d->blocks_per_arena) {
-                size_t i;
-
-                ASSERT(a->free_cnt == d->blocks_per_arena);
-                for (i = 0; i < d->blocks_per_arena; i++) {
-                    struct block* b = arena_to_block(a, i);
-                    list_remove(&b->free_elem);
-                }
-                palloc_free_page(a);
+            /* Put the block in the magazine, if it has room. */
+            old_level = intr_disable();
+            mag = &d->mag;
+            if (malloc_use_magazines && mag->cnt < d->mag_size) {
+                mag->rounds[mag->cnt++] = b;
+                intr_set_level(old_level);
+                return;
             }
 
+            /* The magazine is full: take half of it out too, so
+               that the next few frees do not come back here.
+               desc_free() may call palloc, so it must run with
+               interrupts on, after the blocks leave the magazine. */
+            flush_cnt = 0;
+            if (malloc_use_magazines)
+                while (mag->cnt > d->mag_size / 2)
+                    flush[flush_cnt++] = mag->rounds[--mag->cnt];
+            intr_set_level(old_level);
+
+            lock_acquire(&d->lock);
+            desc_free(d, b);
+            while (flush_cnt > 0)
+                desc_free(d, flush[--flush_cnt]);
             lock_release(&d->lock);
         } else {
             /* It's a big block.  Free its pages. */
@@ -239,6 +314,31 @@ void free(void* p)
     }
 }
 
+/* Returns block B to D's free list, and its arena to the page
+   allocator if the arena is now entirely unused.  D's lock must be
+   held. */
+static void desc_free(struct desc* d, struct block* b)
+{
+    struct arena* a = block_to_arena(b);
+
+    ASSERT(lock_held_by_current_thread(&d->lock));
+
+    /* Add block to free list. */
+    list_push_front(&d->free_list, &b->free_elem);
+
+    /* If the arena is now entirely unused, free it. */
+    if (++a->free_cnt >= d->blocks_per_arena) {
+        size_t i;
+
+        ASSERT(a->free_cnt == d->blocks_per_arena);
+        for (i = 0; i < d->blocks_per_arena; i++) {
+            struct block* b = arena_to_block(a, i);
+            list_remove(&b->free_elem);
+        }
+        palloc_free_page(a);
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena* block_to_arena(struct block* b)
 {
@@ -8,7 +8,34 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
-static uint64_t* pgdir_walk(uint64_t* pdp, const uint64_t va, int create)
+/* Replaces the 2 MB mapping in page directory entry PDE of PML4,
+ * which covers VA, by a page table that maps the same frames with
+ * the same permissions, 4 kB at a time, so that single pages of it
+ * can be changed.  The accessed and dirty bits are not copied: the
+ * huge page's bits say nothing about which of its 4 kB pages were
+ * used.  Besides the kernel's own mapping, only anonymous memory is
+ * mapped by 2 MB pages, and its swap-out writes a page whatever its
+ * dirty bit, so the bits are not kept elsewhere either.  Returns
+ * false if memory allocation failed. */
+static bool pde_split(uint64_t* pml4, uint64_t* pde, const uint64_t va)
+{
+    uint64_t* pt = palloc_get_page(0);
+    uint64_t pa = PTE_ADDR(*pde);
+    uint64_t flags = *pde & PTE_FLAGS & ~(uint64_t)(PTE_PS | PTE_A | PTE_D);
+
+    if (pt == NULL)
+        return false;
+    for (unsigned i = 0; i < HUGE_PGCNT; i++)
+        pt[i] = (pa + i * PGSIZE) | flags;
+    *pde = vtop(pt) | PTE_U | PTE_W | PTE_P;
+
+    /* 활성 pml4일 때만 남아 있는 2 MB TLB 항목을 비움 */
+    if (rcr3() == vtop(pml4))
+        invlpg(va & ~HUGE_PGMASK);
+    return true;
+}
+
+static uint64_t* pgdir_walk(uint64_t* pml4, uint64_t* pdp, const uint64_t va, int create)
 {
     int idx = PDX(va);
     if (pdp) {
@@ -22,13 +49,16 @@ static uint64_t* pgdir_walk(uint64_t* pdp, const uint64_t va, int create)
                     return NULL;
             } else
                 return NULL;
+        } else if (pdp[idx] & PTE_PS) {
+            if (!pde_split(pml4, &pdp[idx], va))
+                return NULL;
         }
         return (uint64_t*)ptov(PTE_ADDR(pdp[idx]) + 8 * PTX(va));
     }
     return NULL;
 }
 
-static uint64_t* pdpe_walk(uint64_t* pdpe, const uint64_t va, int create)
+static uint64_t* pdpe_walk(uint64_t* pml4, uint64_t* pdpe, const uint64_t va, int create)
 {
     uint64_t* pte = NULL;
     int idx = PDPE(va);
@@ -46,7 +76,7 @@ static uint64_t* pdpe_walk(uint64_t* pdpe, const uint64_t va, int create)
             } else
                 return NULL;
         }
-        pte = pgdir_walk(ptov(PTE_ADDR(pdpe[idx])), va, create);
+        pte = pgdir_walk(pml4, ptov(PTE_ADDR(pdpe[idx])), va, create);
     }
     if (pte == NULL && allocated) {
         palloc_free_page((void*)ptov(PTE_ADDR(pdpe[idx])));
@@ -60,7 +90,9 @@ static uint64_t* pdpe_walk(uint64_t* pdpe, const uint64_t va, int create)
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a 2 MB page, the 2 MB page is first split into
+ * 4 kB pages, whatever CREATE is. */
 uint64_t* pml4e_walk(uint64_t* pml4e, const uint64_t va, int create)
 {
     uint64_t* pte = NULL;
@@ -79,7 +111,7 @@ uint64_t* pml4e_walk(uint64_t* pml4e, const uint64_t va, int create)
             } else
                 return NULL;
         }
-        pte = pdpe_walk(ptov(PTE_ADDR(pml4e[idx])), va, create);
+        pte = pdpe_walk(pml4e, ptov(PTE_ADDR(pml4e[idx])), va, create);
     }
     if (pte == NULL && allocated) {
         palloc_free_page((void*)ptov(PTE_ADDR(pml4e[idx])));
@@ -88,6 +120,47 @@ uint64_t* pml4e_walk(uint64_t* pml4e, const uint64_t va, int create)
     return pte;
 }
 
+/* Returns the table that entry IDX of TABLE points to.  If the
+ * entry is not present, behavior depends on CREATE, as in
+ * pml4e_walk(). */
+static uint64_t* next_table(uint64_t* table, int idx, int create)
+{
+    if (!(table[idx] & PTE_P)) {
+        uint64_t* new_page;
+        if (!create || (new_page = palloc_get_page(PAL_ZERO)) == NULL)
+            return NULL;
+        table[idx] = vtop(new_page) | PTE_U | PTE_W | PTE_P;
+    }
+    return ptov(PTE_ADDR(table[idx]));
+}
+
+/* Returns the address of the page directory entry for virtual
+ * address VADDR in page map level 4, pml4, which maps either a page
+ * table or a 2 MB page.  If the upper levels of PML4E do not reach
+ * VADDR, behavior depends on CREATE, as in pml4e_walk().  Upper
+ * levels created for a failed call are kept. */
+uint64_t* pml4e_walk_pde(uint64_t* pml4e, const uint64_t va, int create)
+{
+    uint64_t* pdpe = next_table(pml4e, PML4(va), create);
+    uint64_t* pgdir = pdpe != NULL ? next_table(pdpe, PDPE(va), create) : NULL;
+    return pgdir != NULL ? &pgdir[PDX(va)] : NULL;
+}
+
+/* Returns the entry that maps VA in PML4: its page table entry, or
+ * its page directory entry if VA lies in a 2 MB page.  Returns a
+ * null pointer if there is none.  Unlike pml4e_walk(), never
+ * allocates or splits. */
+static uint64_t* pte_lookup(uint64_t* pml4, const uint64_t va)
+{
+    uint64_t* pde = pml4e_walk_pde(pml4, va, 0);
+
+    if (pde == NULL || !(*pde & PTE_P))
+        return NULL;
+    if (*pde & PTE_PS)
+        return pde;
+    return (uint64_t*)ptov(PTE_ADDR(*pde)) + PTX(va);
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -119,7 +192,8 @@ static bool pgdir_for_each(uint64_t* pdp, pte_for_each_func* func, void* aux, un
 {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t*); i++) {
         uint64_t* pte = ptov((uint64_t*)pdp[i]);
-        if (((uint64_t)pte) & PTE_P)
+        /* 2 MB 페이지에는 page table이 없음 */
+        if ((((uint64_t)pte) & PTE_P) && !(((uint64_t)pte) & PTE_PS))
             if (!pt_for_each((uint64_t*)PTE_ADDR(pte), func, aux, pml4_index, pdp_index, i))
                 return false;
     }
@@ -137,7 +211,8 @@ static bool pdp_for_each(uint64_t* pdp, pte_for_each_func* func, void* aux, unsi
     return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * 2 MB pages have no PTEs and are skipped. */
 bool pml4_for_each(uint64_t* pml4, pte_for_each_func* func, void* aux)
 {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t*); i++) {
@@ -163,7 +238,8 @@ static void pgdir_destroy(uint64_t* pdp)
 {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t*); i++) {
         uint64_t* pte = ptov((uint64_t*)pdp[i]);
-        if (((uint64_t)pte) & PTE_P)
+        /* 2 MB 페이지의 프레임은 frame table이 회수함 */
+        if ((((uint64_t)pte) & PTE_P) && !(((uint64_t)pte) & PTE_PS))
             pt_destroy(PTE_ADDR(pte));
     }
     palloc_free_page((void*)pdp);
@@ -208,9 +284,13 @@ void* pml4_get_page(uint64_t* pml4, const void* uaddr)
 {
     ASSERT(is_user_vaddr(uaddr));
 
-    uint64_t* pte = pml4e_walk(pml4, (uint64_t)uaddr, 0);
+    uint64_t* pte = pte_lookup(pml4, (uint64_t)uaddr);
 
-    if (pte && (*pte & PTE_P))
+    if (pte == NULL)
+        return NULL;
+    if (*pte & PTE_PS)
+        return ptov(PTE_ADDR(*pte)) + ((uint64_t)uaddr & HUGE_PGMASK);
+    if (*pte & PTE_P)
         return ptov(PTE_ADDR(*pte)) + pg_ofs(uaddr);
     return NULL;
 }
@@ -237,6 +317,42 @@ bool pml4_set_page(uint64_t* pml4, void* upage, void* kpage, bool rw)
     return pte != NULL;
 }
 
+/* Adds a 2 MB mapping in page map level 4 PML4 from user virtual
+ * address UPAGE to the physically contiguous frames starting at
+ * kernel virtual address KPAGE.  Both must be 2 MB aligned.  A page
+ * table already covering UPAGE is freed and its mappings are
+ * dropped; the caller must own the frames it mapped.
+ * If WRITABLE is true, the new pages are read/write; otherwise
+ * they are read-only.
+ * Returns true if successful, false if memory allocation
+ * failed. */
+bool pml4_set_huge_page(uint64_t* pml4, void* upage, void* kpage, bool rw)
+{
+    ASSERT(((uint64_t)upage & HUGE_PGMASK) == 0);
+    ASSERT((vtop(kpage) & HUGE_PGMASK) == 0);
+    ASSERT(is_user_vaddr(upage));
+    ASSERT(pml4 != base_pml4);
+
+    uint64_t* pde = pml4e_walk_pde(pml4, (uint64_t)upage, 1);
+
+    if (pde == NULL)
+        return false;
+    if ((*pde & PTE_P) && !(*pde & PTE_PS))
+        palloc_free_page(ptov(PTE_ADDR(*pde)));
+    *pde = vtop(kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+    if (rcr3() == vtop(pml4))
+        lcr3(rcr3());
+    return true;
+}
+
+/* Returns true if user virtual page UPAGE lies in a 2 MB page in
+ * PML4. */
+bool pml4_is_huge(uint64_t* pml4, const void* upage)
+{
+    uint64_t* pde = pml4e_walk_pde(pml4, (uint64_t)upage, 0);
+    return pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -258,11 +374,12 @@ void pml4_clear_page(uint64_t* pml4, void* upage)
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
- * installed.
+ * installed.  In a 2 MB page, this is true if any of its pages has
+ * been modified.
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool pml4_is_dirty(uint64_t* pml4, const void* vpage)
 {
-    uint64_t* pte = pml4e_walk(pml4, (uint64_t)vpage, false);
+    uint64_t* pte = pte_lookup(pml4, (uint64_t)vpage);
     return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -282,21 +399,39 @@ void pml4_set_dirty(uint64_t* pml4, const void* vpage, bool dirty)
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+ * VPAGE in PML4. */
+void pml4_set_writable(uint64_t* pml4, const void* vpage, bool writable)
+{
+    uint64_t* pte = pml4e_walk(pml4, (uint64_t)vpage, false);
+    if (pte) {
+        if (writable)
+            *pte |= PTE_W;
+        else
+            *pte &= ~(uint64_t)PTE_W;
+
+        if (rcr3() == vtop(pml4))
+            invlpg((uint64_t)vpage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
  * accessed recently, that is, between the time the PTE was
- * installed and the last time it was cleared.  Returns false if
- * PML4 contains no PTE for VPAGE. */
+ * installed and the last time it was cleared.  In a 2 MB page,
+ * this is true if any of its pages has been accessed.  Returns
+ * false if PML4 contains no PTE for VPAGE. */
 bool pml4_is_accessed(uint64_t* pml4, const void* vpage)
 {
-    uint64_t* pte = pml4e_walk(pml4, (uint64_t)vpage, false);
+    uint64_t* pte = pte_lookup(pml4, (uint64_t)vpage);
     return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  In a 2 MB page, sets it for all of its pages
+   instead of splitting it. */
 void pml4_set_accessed(uint64_t* pml4, const void* vpage, bool accessed)
 {
-    uint64_t* pte = pml4e_walk(pml4, (uint64_t)vpage, false);
+    uint64_t* pte = pte_lookup(pml4, (uint64_t)vpage);
     if (pte) {
         if (accessed)
             *pte |= PTE_A;
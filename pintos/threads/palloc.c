@@ -2,6 +2,7 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -24,13 +25,51 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept as
+   blocks of 2**K pages, for K up to MAX_ORDER, each aligned to its
+   own size relative to the pool's base, on one free list per
+   order.  A request is rounded up to a power of 2, served by
+   splitting the smallest large-enough free block, and the pages
+   past the request are freed again at once.  Freeing a block
+   merges it with its "buddy", the other half of the next larger
+   block, for as long as that buddy is free.  Both take O(log n)
+   time, and a single page comes straight off the order-0 list
+   whenever there is one.
+
+   The free lists are threaded through a per-page array kept
+   outside the pool, not through the free pages themselves: the
+   boot page table does not map all of memory yet when the pools
+   are populated.
+
+   Building with PALLOC_CHECK defined also keeps the original
+   bitmap of used pages and checks every allocation and free
+   against it. */
+
+/* Largest block, in log2 pages. */
+#define MAX_ORDER 18
+
+/* Order of a page that does not start a free block. */
+#define ORDER_NONE UINT8_MAX
+
+/* Per-page information. */
+struct page_info {
+    struct list_elem free_elem; /* Element in a free list, if ORDER is not ORDER_NONE. */
+    uint8_t order;              /* Order of the free block this page starts. */
+};
 
 /* A memory pool. */
 struct pool {
-    struct lock lock;        /* Mutual exclusion. */
-    struct bitmap* used_map; /* Bitmap of free pages. */
-    uint8_t* base;           /* Base of pool. */
+    struct spinlock lock;            /* Mutual exclusion. */
+    uint8_t* base;                   /* Base of pool. */
+    size_t page_cnt;                 /* Number of pages in the pool. */
+    struct page_info* pages;         /* Information about each page. */
+    struct list free[MAX_ORDER + 1]; /* Free blocks, by order. */
+    uint32_t free_orders;            /* Bit K is set iff FREE[K] is non-empty. */
+#ifdef PALLOC_CHECK
+    struct bitmap* used_map; /* Bitmap of used pages. */
+#endif
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -41,6 +80,9 @@ size_t user_page_limit = SIZE_MAX;
 static void init_pool(struct pool* p, void** bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool(const struct pool*, void* page);
+static size_t block_alloc(struct pool*, unsigned order);
+static void block_free(struct pool*, size_t page_idx, unsigned order);
+static void range_free(struct pool*, size_t page_idx, size_t page_cnt);
 
 /* multiboot info */
 struct multiboot_info {
@@ -219,16 +261,16 @@ static void populate_pools(struct area* base_mem, struct area* ext_mem)
             else
                 NOT_REACHED();
 
-            pool_end = pool->base + bitmap_size(pool->used_map) * PGSIZE;
+            pool_end = pool->base + pool->page_cnt * PGSIZE;
             page_idx = pg_no(start) - pg_no(pool->base);
             if ((uint64_t)pool_end < end) {
                 page_cnt = ((uint64_t)pool_end - start) / PGSIZE;
-                bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+                range_free(pool, page_idx, page_cnt);
                 start = (uint64_t)pool_end;
                 goto split;
             } else {
                 page_cnt = ((uint64_t)end - start) / PGSIZE;
-                bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+                range_free(pool, page_idx, page_cnt);
             }
         }
     }
@@ -260,13 +302,28 @@ uint64_t palloc_init(void)
 void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt)
 {
     struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-    lock_acquire(&pool->lock);
-    size_t page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-    lock_release(&pool->lock);
+    unsigned order = 0;
+    size_t page_idx = SIZE_MAX;
     void* pages;
 
-    if (page_idx != BITMAP_ERROR)
+    while (((size_t)1 << order) < page_cnt && order <= MAX_ORDER)
+        order++;
+
+    if (page_cnt > 0 && order <= MAX_ORDER) {
+        spinlock_acquire(&pool->lock);
+        page_idx = block_alloc(pool, order);
+        if (page_idx != SIZE_MAX) {
+            /* Give back the pages past the request. */
+            range_free(pool, page_idx + page_cnt, ((size_t)1 << order) - page_cnt);
+#ifdef PALLOC_CHECK
+            ASSERT(bitmap_none(pool->used_map, page_idx, page_cnt));
+            bitmap_set_multiple(pool->used_map, page_idx, page_cnt, true);
+#endif
+        }
+        spinlock_release(&pool->lock);
+    }
+
+    if (page_idx != SIZE_MAX)
         pages = pool->base + PGSIZE * page_idx;
     else
         pages = NULL;
@@ -294,6 +351,16 @@ void* palloc_get_page(enum palloc_flags flags)
     return palloc_get_multiple(flags, 1);
 }
 
+/* Stores the base address and the number of pages of the user
+   pool into *BASE and *PAGE_CNT.  Lets the frame table size itself
+   to the pool and map a kernel virtual address to its frame in
+   O(1). */
+void palloc_user_pool_range(void** base, size_t* page_cnt)
+{
+    *base = user_pool.base;
+    *page_cnt = user_pool.page_cnt;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void palloc_free_multiple(void* pages, size_t page_cnt)
 {
@@ -316,8 +383,14 @@ void palloc_free_multiple(void* pages, size_t page_cnt)
 #ifndef NDEBUG
     memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
+    spinlock_acquire(&pool->lock);
+    ASSERT(pool->pages[page_idx].order == ORDER_NONE);
+#ifdef PALLOC_CHECK
     ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
     bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+#endif
+    range_free(pool, page_idx, page_cnt);
+    spinlock_release(&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -326,23 +399,36 @@ void palloc_free_page(void* page)
     palloc_free_multiple(page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END */
+/* Initializes pool P as starting at START and ending at END,
+   with every page in use.  The per-page array (and the bitmap, with
+   PALLOC_CHECK) is carved from *BM_BASE, which is advanced past
+   it. */
 static void init_pool(struct pool* p, void** bm_base, uint64_t start, uint64_t end)
 {
-    /* We'll put the pool's used_map at its base.
-       Calculate the space needed for the bitmap
-       and subtract it from the pool's size. */
     uint64_t pgcnt = (end - start) / PGSIZE;
-    size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(pgcnt), PGSIZE) * PGSIZE;
+    size_t info_bytes = ROUND_UP(sizeof *p->pages * pgcnt, PGSIZE);
 
-    lock_init(&p->lock);
-    p->used_map = bitmap_create_in_buf(pgcnt, *bm_base, bm_pages);
+    /* Pool spinlocks are not registered with lock_print_stats(),
+       which only knows sleeping locks.  A spinlock is needed here:
+       thread teardown frees pages with interrupts off, in the
+       middle of a context switch, where sleeping is impossible. */
+    spinlock_init(&p->lock);
     p->base = (void*)start;
-
-    // Mark all to unusable.
+    p->page_cnt = pgcnt;
+    p->pages = *bm_base;
+    for (size_t i = 0; i < pgcnt; i++)
+        p->pages[i].order = ORDER_NONE;
+    for (int k = 0; k <= MAX_ORDER; k++)
+        list_init(&p->free[k]);
+    p->free_orders = 0;
+    *bm_base += info_bytes;
+
+#ifdef PALLOC_CHECK
+    size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(pgcnt), PGSIZE) * PGSIZE;
+    p->used_map = bitmap_create_in_buf(pgcnt, *bm_base, bm_pages);
     bitmap_set_all(p->used_map, true);
-
     *bm_base += bm_pages;
+#endif
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -351,6 +437,85 @@ static bool page_from_pool(const struct pool* pool, void* page)
 {
     size_t page_no = pg_no(page);
     size_t start_page = pg_no(pool->base);
-    size_t end_page = start_page + bitmap_size(pool->used_map);
+    size_t end_page = start_page + pool->page_cnt;
     return page_no >= start_page && page_no < end_page;
 }
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX on its free
+   list. */
+static void block_push(struct pool* pool, size_t page_idx, unsigned order)
+{
+    pool->pages[page_idx].order = order;
+    list_push_front(&pool->free[order], &pool->pages[page_idx].free_elem);
+    pool->free_orders |= 1u << order;
+}
+
+/* Takes the free block of 2**ORDER pages at PAGE_IDX off its free
+   list. */
+static void block_unlink(struct pool* pool, size_t page_idx, unsigned order)
+{
+    ASSERT(pool->pages[page_idx].order == order);
+
+    list_remove(&pool->pages[page_idx].free_elem);
+    pool->pages[page_idx].order = ORDER_NONE;
+    if (list_empty(&pool->free[order]))
+        pool->free_orders &= ~(1u << order);
+}
+
+/* Allocates a block of 2**ORDER pages from POOL and returns the
+   index of its first page, or SIZE_MAX if there is none.  POOL's
+   lock must be held. */
+static size_t block_alloc(struct pool* pool, unsigned order)
+{
+    uint32_t usable = pool->free_orders & ~((1u << order) - 1);
+    size_t page_idx;
+    unsigned k;
+
+    if (usable == 0)
+        return SIZE_MAX;
+
+    /* Take the smallest block that is large enough... */
+    k = __builtin_ctz(usable);
+    page_idx = list_entry(list_front(&pool->free[k]), struct page_info, free_elem) - pool->pages;
+    block_unlink(pool, page_idx, k);
+
+    /* ...and free its upper halves until it has the right size. */
+    while (k > order) {
+        k--;
+        block_push(pool, page_idx + ((size_t)1 << k), k);
+    }
+    return page_idx;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX, merging it with
+   its buddy as long as the buddy is free.  POOL's lock must be
+   held, except while the pools are populated. */
+static void block_free(struct pool* pool, size_t page_idx, unsigned order)
+{
+    while (order < MAX_ORDER) {
+        size_t buddy = page_idx ^ ((size_t)1 << order);
+
+        if (buddy + ((size_t)1 << order) > pool->page_cnt || pool->pages[buddy].order != order)
+            break;
+        block_unlink(pool, buddy, order);
+        page_idx &= ~((size_t)1 << order);
+        order++;
+    }
+    block_push(pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX, which need not form a
+   block, as the largest aligned blocks that fit. */
+static void range_free(struct pool* pool, size_t page_idx, size_t page_cnt)
+{
+    while (page_cnt > 0) {
+        unsigned order = 0;
+
+        while (order < MAX_ORDER && (page_idx & ((size_t)1 << order)) == 0
+               && ((size_t)2 << order) <= page_cnt)
+            order++;
+        block_free(pool, page_idx, order);
+        page_idx += (size_t)1 << order;
+        page_cnt -= (size_t)1 << order;
+    }
+}
@@ -0,0 +1,276 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches for fixed-size kernel objects.  See [Bonwick94].
+
+   malloc() rounds every request up to a power of 2, so a 150-byte
+   structure occupies a 256-byte block.  A cache instead carves
+   single pages, called slabs, into objects of exactly one size.
+   Each slab begins with a header and an array that links its free
+   objects by index, followed by the objects themselves.
+
+   Because the free list lives in the header and not in the
+   objects, a freed object keeps its contents.  A cache's
+   constructor therefore runs only once per object, when its slab
+   is created, and kmem_cache_free() expects the object back in its
+   constructed state.
+
+   The bytes a slab cannot use are spread between its start and its
+   end: each new slab of a cache shifts its objects by one more
+   cache line than the last, so that the same object in different
+   slabs does not always land in the same cache set. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0bea
+
+/* Size of a CPU cache line, the unit of slab coloring. */
+#define CACHE_LINE 64
+
+/* Ends a slab's free list. */
+#define SLAB_NONE UINT16_MAX
+
+/* An object cache. */
+struct kmem_cache {
+    const char* name;      /* For statistics and the lock. */
+    size_t size;           /* Object size, a multiple of ALIGN. */
+    size_t align;          /* Object alignment. */
+    kmem_ctor* ctor;       /* Constructor, or a null pointer. */
+    size_t obj_cnt;        /* Objects per slab. */
+    size_t color_cnt;      /* Number of different slab colors. */
+    size_t color_next;     /* Color of the next slab. */
+    struct lock lock;      /* Protects the lists and counters. */
+    struct list partial;   /* Slabs with both free and used objects. */
+    struct list full;      /* Slabs without free objects. */
+    struct list empty;     /* At most one slab without used objects. */
+    struct list_elem elem; /* Element in all_caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;              /* Slabs owned. */
+    size_t in_use;                /* Objects allocated. */
+    unsigned long long alloc_cnt; /* Calls to kmem_cache_alloc(). */
+    unsigned long long free_cnt;  /* Calls to kmem_cache_free(). */
+};
+
+/* Slab header, at the start of its page. */
+struct slab {
+    unsigned magic;           /* Always set to SLAB_MAGIC. */
+    struct kmem_cache* cache; /* Owning cache. */
+    struct list_elem elem;    /* Element in one of CACHE's lists. */
+    uint8_t* objs;            /* First object. */
+    uint16_t in_use;          /* Objects allocated. */
+    uint16_t free;            /* First free object, or SLAB_NONE. */
+    uint16_t next[];          /* Free object following each free object. */
+};
+
+/* Every cache, for kmem_cache_print_stats(). */
+static struct list all_caches;
+static bool all_caches_ready;
+
+static struct slab* slab_create(struct kmem_cache*);
+static struct slab* obj_to_slab(struct kmem_cache*, void*);
+
+/* Creates and returns a cache of objects of SIZE bytes aligned on
+   ALIGN bytes, which must be a power of 2 no greater than a cache
+   line, or 0 for pointer alignment.  CTOR, if non-null, constructs
+   each object once.  NAME must remain valid for as long as the
+   cache exists.  Returns a null pointer if memory is not
+   available.
+
+   A slab must hold at least one object; larger objects should be
+   obtained from malloc(). */
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor* ctor)
+{
+    struct kmem_cache* c;
+    size_t hdr;
+
+    if (align == 0)
+        align = sizeof(void*);
+    ASSERT(name != NULL);
+    ASSERT(size > 0);
+    ASSERT((align & (align - 1)) == 0 && align <= CACHE_LINE);
+
+    c = malloc(sizeof *c);
+    if (c == NULL)
+        return NULL;
+
+    c->name = name;
+    c->size = ROUND_UP(size, align);
+    c->align = align;
+    c->ctor = ctor;
+
+    /* Fit as many objects as possible, with one free-list entry
+       each in the header. */
+    c->obj_cnt = (PGSIZE - sizeof(struct slab)) / (c->size + sizeof(uint16_t));
+    for (;;) {
+        hdr = ROUND_UP(sizeof(struct slab) + c->obj_cnt * sizeof(uint16_t), align);
+        if (hdr + c->obj_cnt * c->size <= PGSIZE)
+            break;
+        c->obj_cnt--;
+    }
+    ASSERT(c->obj_cnt > 0 && c->obj_cnt < SLAB_NONE);
+    c->color_cnt = (PGSIZE - hdr - c->obj_cnt * c->size) / CACHE_LINE + 1;
+    c->color_next = 0;
+
+    lock_init(&c->lock);
+    lock_register(&c->lock, name);
+    list_init(&c->partial);
+    list_init(&c->full);
+    list_init(&c->empty);
+    c->slab_cnt = 0;
+    c->in_use = 0;
+    c->alloc_cnt = 0;
+    c->free_cnt = 0;
+
+    if (!all_caches_ready) {
+        list_init(&all_caches);
+        all_caches_ready = true;
+    }
+    list_push_back(&all_caches, &c->elem);
+    return c;
+}
+
+/* Allocates and returns an object from cache C, in its
+   constructed state.  Returns a null pointer if memory is not
+   available. */
+void* kmem_cache_alloc(struct kmem_cache* c)
+{
+    struct slab* s;
+    uint16_t idx;
+
+    ASSERT(c != NULL);
+
+    lock_acquire(&c->lock);
+    if (list_empty(&c->partial)) {
+        if (!list_empty(&c->empty))
+            s = list_entry(list_pop_front(&c->empty), struct slab, elem);
+        else if ((s = slab_create(c)) == NULL) {
+            lock_release(&c->lock);
+            return NULL;
+        }
+        list_push_front(&c->partial, &s->elem);
+    }
+
+    s = list_entry(list_front(&c->partial), struct slab, elem);
+    idx = s->free;
+    s->free = s->next[idx];
+    s->in_use++;
+    if (s->free == SLAB_NONE) {
+        list_remove(&s->elem);
+        list_push_front(&c->full, &s->elem);
+    }
+    c->in_use++;
+    c->alloc_cnt++;
+    lock_release(&c->lock);
+
+    return s->objs + idx * c->size;
+}
+
+/* Returns OBJ, which must have been allocated from cache C and must
+   be in its constructed state, to C. */
+void kmem_cache_free(struct kmem_cache* c, void* obj)
+{
+    struct slab* s;
+    uint16_t idx;
+
+    if (obj == NULL)
+        return;
+
+    s = obj_to_slab(c, obj);
+    idx = ((uint8_t*)obj - s->objs) / c->size;
+
+    lock_acquire(&c->lock);
+    if (s->free == SLAB_NONE) {
+        list_remove(&s->elem);
+        list_push_front(&c->partial, &s->elem);
+    }
+    s->next[idx] = s->free;
+    s->free = idx;
+    c->in_use--;
+    c->free_cnt++;
+
+    /* Keep one empty slab around, so that a cache whose use
+       hovers around a slab boundary does not keep going back to
+       the page allocator. */
+    if (--s->in_use == 0) {
+        list_remove(&s->elem);
+        if (list_empty(&c->empty))
+            list_push_front(&c->empty, &s->elem);
+        else {
+            s->magic = 0;
+            c->slab_cnt--;
+            palloc_free_page(s);
+        }
+    }
+    lock_release(&c->lock);
+}
+
+/* Prints statistics for every cache that has been used. */
+void kmem_cache_print_stats(void)
+{
+    struct list_elem* e;
+
+    if (!all_caches_ready)
+        return;
+    for (e = list_begin(&all_caches); e != list_end(&all_caches); e = list_next(e)) {
+        struct kmem_cache* c = list_entry(e, struct kmem_cache, elem);
+        if (c->alloc_cnt > 0)
+            printf("Slab %s: %zu in use, %zu slabs of %zu %zu-byte objects, %llu allocated, %llu freed\n", c->name,
+                   c->in_use, c->slab_cnt, c->obj_cnt, c->size, c->alloc_cnt, c->free_cnt);
+    }
+}
+
+/* Obtains a page for cache C, lays it out as a slab, and constructs
+   its objects.  Returns a null pointer if memory is not available.
+   C's lock must be held. */
+static struct slab* slab_create(struct kmem_cache* c)
+{
+    struct slab* s;
+    size_t i;
+
+    ASSERT(lock_held_by_current_thread(&c->lock));
+
+    s = palloc_get_page(0);
+    if (s == NULL)
+        return NULL;
+
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->objs = (uint8_t*)s + PGSIZE - c->obj_cnt * c->size;
+    s->objs -= c->color_next * CACHE_LINE;
+    s->objs = (uint8_t*)ROUND_DOWN((uintptr_t)s->objs, c->align);
+    c->color_next = (c->color_next + 1) % c->color_cnt;
+    s->in_use = 0;
+    s->free = 0;
+    for (i = 0; i < c->obj_cnt; i++) {
+        s->next[i] = i + 1 < c->obj_cnt ? i + 1 : SLAB_NONE;
+        if (c->ctor != NULL)
+            c->ctor(s->objs + i * c->size);
+    }
+    c->slab_cnt++;
+    return s;
+}
+
+/* Returns the slab of cache C that OBJ is inside. */
+static struct slab* obj_to_slab(struct kmem_cache* c, void* obj)
+{
+    struct slab* s = pg_round_down(obj);
+
+    /* Check that the slab is valid. */
+    ASSERT(s->magic == SLAB_MAGIC);
+    ASSERT(s->cache == c);
+
+    /* Check that the object is properly aligned for the slab. */
+    ASSERT((uint8_t*)obj >= s->objs);
+    ASSERT(((uint8_t*)obj - s->objs) % c->size == 0);
+    ASSERT(((uint8_t*)obj - s->objs) / c->size < c->obj_cnt);
+
+    return s;
+}
@@ -31,6 +31,7 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
 
 /* One semaphore in a list. */
 struct semaphore_elem {
@@ -99,6 +100,56 @@ void sema_init(struct semaphore* sema, unsigned value)
     list_init(&sema->waiters);
 }
 
+/* Initializes spinlock LOCK as released. */
+void spinlock_init(struct spinlock* lock)
+{
+    ASSERT(lock != NULL);
+
+    lock->next = 0;
+    lock->owner = 0;
+    lock->saved_level = INTR_OFF;
+}
+
+/* Acquires spinlock LOCK, spinning until it is free.  Waiters are
+   served in the order they arrive.  Interrupts stay off until the
+   matching spinlock_release(), so a timer interrupt cannot preempt
+   the holder. */
+void spinlock_acquire(struct spinlock* lock)
+{
+    enum intr_level old_level;
+    uint32_t ticket;
+
+    ASSERT(lock != NULL);
+
+    old_level = intr_disable();
+    ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+        asm volatile("pause");
+    lock->saved_level = old_level;
+}
+
+/* Releases spinlock LOCK and restores the interrupt level from
+   before it was acquired.  Spinlocks must be released in the
+   reverse order of acquisition. */
+void spinlock_release(struct spinlock* lock)
+{
+    enum intr_level old_level;
+
+    ASSERT(spinlock_held(lock));
+
+    old_level = lock->saved_level;
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+    intr_set_level(old_level);
+}
+
+/* Returns true if LOCK is held. */
+bool spinlock_held(const struct spinlock* lock)
+{
+    ASSERT(lock != NULL);
+
+    return lock->next != lock->owner;
+}
+
 /* 	Down or "P" 세마포어에 대한 Down 또는 P 연산
     SEMA의 값이 양수가 될 때까지 기다린 다음, 원자적으로 값을 1 감소시킴
 
@@ -115,8 +166,9 @@ void sema_down(struct semaphore* sema)
 
     old_level = intr_disable();
     while (sema->value == 0) {
-        // project 1-2 우선순위 순으로 넣기
-        list_insert_ordered(&sema->waiters, &thread_current()->elem, cmp_priority_more, NULL);
+        /* 도착 순으로 넣고, 깨울 때 가장 높은 우선순위를 고른다.
+           기다리는 동안 donation으로 우선순위가 바뀔 수 있다. */
+        list_push_back(&sema->waiters, &thread_current()->elem);
         thread_block();
     }
     sema->value--;
@@ -158,8 +210,9 @@ void sema_up(struct semaphore* sema)
 
     old_level = intr_disable();
     if (!list_empty(&sema->waiters)) {
-        list_sort(&sema->waiters, cmp_priority_more, NULL);
-        thread_unblock(list_entry(list_pop_front(&sema->waiters), struct thread, elem));
+        struct list_elem* e = list_min(&sema->waiters, cmp_priority_more, NULL);
+        list_remove(e);
+        thread_unblock(list_entry(e, struct thread, elem));
     }
     sema->value++;
     thread_preempted();
@@ -220,6 +273,51 @@ void lock_init(struct lock* lock)
 
     lock->holder = NULL;
     sema_init(&lock->semaphore, 1);
+    lock->name = NULL;
+    lock->acquired = 0;
+    lock->contended = 0;
+    lock->wait_ticks = 0;
+}
+
+/* Locks given a name with lock_register(), for lock_print_stats(). */
+static struct list named_locks;
+static bool named_locks_ready;
+
+/* Names LOCK, which must already be initialized and must never be
+   freed, and reports its statistics in lock_print_stats(). */
+void lock_register(struct lock* lock, const char* name)
+{
+    enum intr_level old_level;
+
+    ASSERT(lock != NULL);
+    ASSERT(name != NULL);
+    ASSERT(lock->name == NULL);
+
+    old_level = intr_disable();
+    if (!named_locks_ready) {
+        list_init(&named_locks);
+        named_locks_ready = true;
+    }
+    lock->name = name;
+    list_push_back(&named_locks, &lock->named_elem);
+    intr_set_level(old_level);
+}
+
+/* Prints how often each registered lock was acquired, how often
+   its acquirer had to wait, and for how many timer ticks in
+   total. */
+void lock_print_stats(void)
+{
+    struct list_elem* e;
+
+    if (!named_locks_ready)
+        return;
+    for (e = list_begin(&named_locks); e != list_end(&named_locks); e = list_next(e)) {
+        struct lock* lock = list_entry(e, struct lock, named_elem);
+        if (lock->acquired > 0)
+            printf("Lock %s: %llu acquired, %llu contended, %lld ticks waiting\n", lock->name, lock->acquired,
+                   lock->contended, (long long)lock->wait_ticks);
+    }
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -236,8 +334,17 @@ void lock_acquire(struct lock* lock)
     ASSERT(!intr_context());
     ASSERT(!lock_held_by_current_thread(lock));
 
+    /* Fast path: an uncontended lock costs no more than a
+       successful sema_try_down(). */
+    if (lock_try_acquire(lock))
+        return;
+
     // project1-3 donation
+    /* 기부와 대기열 삽입을 인터럽트 없이 한 번에 해야
+       lock_release()가 대기자 없음을 보고 donation을 건너뛸 수 있다. */
     struct thread* curr = thread_current();
+    int64_t start = timer_ticks();
+    enum intr_level old_level = intr_disable();
     if (lock->holder != NULL) {
         curr->lock_on_wait = lock;
         list_insert_ordered(&(lock->holder->donation), &(curr->donation_elem), cmp_done_priority, NULL);
@@ -246,7 +353,12 @@ void lock_acquire(struct lock* lock)
     sema_down(&lock->semaphore);
     // 획득했으니까 풀어줌
     curr->lock_on_wait = NULL;
-    lock->holder = thread_current();
+    lock->holder = curr;
+    intr_set_level(old_level);
+
+    lock->acquired++;
+    lock->contended++;
+    lock->wait_ticks += timer_elapsed(start);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -263,8 +375,10 @@ bool lock_try_acquire(struct lock* lock)
     ASSERT(!lock_held_by_current_thread(lock));
 
     success = sema_try_down(&lock->semaphore);
-    if (success)
+    if (success) {
         lock->holder = thread_current();
+        lock->acquired++;
+    }
     return success;
 }
 
@@ -276,14 +390,27 @@ bool lock_try_acquire(struct lock* lock)
    handler. */
 void lock_release(struct lock* lock)
 {
+    enum intr_level old_level;
+
     ASSERT(lock != NULL);
     ASSERT(lock_held_by_current_thread(lock));
 
+    /* Fast path: with no waiters there are no donors to drop and
+       nobody to wake. */
+    old_level = intr_disable();
+    if (list_empty(&lock->semaphore.waiters)) {
+        lock->holder = NULL;
+        lock->semaphore.value++;
+        intr_set_level(old_level);
+        return;
+    }
+
     kill_donor(lock);
     retrieve_priority();
 
     lock->holder = NULL;
     sema_up(&lock->semaphore);
+    intr_set_level(old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -336,8 +463,7 @@ void cond_wait(struct condition* cond, struct lock* lock)
     ASSERT(lock_held_by_current_thread(lock));
 
     sema_init(&waiter.semaphore, 0);
-    // project1-2-> 뒤에다 넣지말고 잘 넣기
-    list_insert_ordered(&cond->waiters, &waiter.elem, cmp_sema_priority, NULL);
+    list_push_back(&cond->waiters, &waiter.elem);
     lock_release(lock);
     sema_down(&waiter.semaphore);
     lock_acquire(lock);
@@ -358,8 +484,9 @@ void cond_signal(struct condition* cond, struct lock* lock UNUSED)
     ASSERT(lock_held_by_current_thread(lock));
 
     if (!list_empty(&cond->waiters)) {
-        list_sort(&cond->waiters, cmp_sema_priority, NULL);
-        sema_up(&list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
+        struct list_elem* e = list_min(&cond->waiters, cmp_sema_priority, NULL);
+        list_remove(e);
+        sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
     }
 }
 
@@ -378,6 +505,79 @@ void cond_broadcast(struct condition* cond, struct lock* lock)
         cond_signal(cond, lock);
 }
 
+/* Initializes RWLOCK. Any number of readers may hold a readers-writer
+   lock at once, or a single writer. Neither side may be acquired
+   recursively. */
+void rwlock_init(struct rwlock* rwlock)
+{
+    ASSERT(rwlock != NULL);
+
+    lock_init(&rwlock->lock);
+    sema_init(&rwlock->drained, 0);
+    rwlock->readers = 0;
+    rwlock->writer_waiting = false;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void rwlock_acquire_read(struct rwlock* rwlock)
+{
+    enum intr_level old_level;
+
+    lock_acquire(&rwlock->lock);
+    old_level = intr_disable();
+    rwlock->readers++;
+    intr_set_level(old_level);
+    lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, held for reading by the current thread. */
+void rwlock_release_read(struct rwlock* rwlock)
+{
+    enum intr_level old_level;
+
+    // reader는 lock을 잡지 않고 나감: writer가 lock을 쥔 채 기다리고 있을 수 있음
+    old_level = intr_disable();
+    ASSERT(rwlock->readers > 0);
+    if (--rwlock->readers == 0 && rwlock->writer_waiting) {
+        rwlock->writer_waiting = false;
+        sema_up(&rwlock->drained);
+    }
+    intr_set_level(old_level);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or writer
+   holds it. */
+void rwlock_acquire_write(struct rwlock* rwlock)
+{
+    enum intr_level old_level;
+
+    lock_acquire(&rwlock->lock);
+    old_level = intr_disable();
+    if (rwlock->readers > 0) {
+        rwlock->writer_waiting = true;
+        sema_down(&rwlock->drained);
+    }
+    intr_set_level(old_level);
+}
+
+/* Releases RWLOCK, held for writing by the current thread. */
+void rwlock_release_write(struct rwlock* rwlock)
+{
+    ASSERT(rwlock_held_for_write(rwlock));
+    ASSERT(rwlock->readers == 0);
+
+    lock_release(&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing. */
+bool rwlock_held_for_write(const struct rwlock* rwlock)
+{
+    ASSERT(rwlock != NULL);
+
+    return lock_held_by_current_thread(&rwlock->lock);
+}
+
 void donation_priority(void)
 {
     struct thread* curr = thread_current();
@@ -388,7 +588,7 @@ void donation_priority(void)
         if (curr->lock_on_wait == NULL)
             return;
         holder = curr->lock_on_wait->holder;
-        holder->priority = priority;
+        thread_set_effective_priority(holder, priority);
         curr = holder;
     }
 }
@@ -400,9 +600,9 @@ void retrieve_priority(void)
     struct thread* donations_front;
 
     if (list_empty(donations)) {
-        curr->priority = curr->actual_priority;
+        thread_set_effective_priority(curr, curr->actual_priority);
         return;
     }
     donations_front = list_entry(list_front(donations), struct thread, donation_elem);
-    curr->priority = donations_front->priority;
+    thread_set_effective_priority(curr, donations_front->priority);
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "intrinsic.h"
 #include "fixed-point.h"
 #include "threads/init.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -26,13 +27,14 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Project 1 - Alarm Clock */
-static struct list sleep_list;
-/* ~Alarm Clock 1 */
+/* Run queue: processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   FIFO list per priority.  Bit (PRI_MAX - P) of ready_bitmap is set
+   exactly when ready_queues[P] is non-empty, so the highest runnable
+   priority is found with a single find-first-set. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static size_t ready_cnt; /* # of threads on the run queue. */
 
 /* Idle thread. */
 static struct thread* idle_thread;
@@ -62,6 +64,23 @@ bool thread_mlfqs;
 // project 1-4 advenced
 static int load_avg = LOAD_AVG_DEFAULT;
 
+/* The advanced scheduler is incremental: a tick touches only the
+   running thread, and a second boundary touches only the threads
+   that are running or ready.  A blocked thread's recent_cpu is
+   brought up to date when it is unblocked, by replaying the decay
+   coefficients it missed.
+
+   DECAY_EPOCH counts second boundaries.  decay_coef[E % DECAY_LOG]
+   holds the coefficient (2*load_avg)/(2*load_avg + 1) that was
+   applied at the end of second E. */
+#define DECAY_LOG 64
+static unsigned decay_epoch;
+static int decay_coef[DECAY_LOG];
+
+/* Threads charged a tick of recent_cpu since the last priority
+   recomputation.  Holds at most 4 threads. */
+static struct list charged_list;
+
 static void kernel_thread(thread_func*, void* aux);
 
 static void idle(void* aux UNUSED);
@@ -70,14 +89,16 @@ static void init_thread(struct thread*, const char* name, int priority);
 static void do_schedule(int status);
 static void schedule(void);
 static tid_t allocate_tid(void);
+static void ready_push(struct thread*);
+static void ready_remove(struct thread*);
+static int ready_max_priority(void);
+static int mlfqs_priority(const struct thread*);
+static void mlfqs_catch_up(struct thread*);
 
 /* Project 1 - Alarm Clock */
-static bool cmp_awake_less(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED);
+static void thread_wakeup(void* t_);
 /* ~Alarm Clock */
 
-/* Project 1 - priority_cmp */
-static bool cmp_priority_more(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED);
-/* ~Alarm Clock */
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -119,10 +140,12 @@ void thread_init(void)
 
     /* Init the globla thread context */
     lock_init(&tid_lock);
-    list_init(&ready_list);
-    /* Project 1 - Alarm Clock */
-    list_init(&sleep_list);
-    /* ~Alarm Clock 1 */
+    lock_register(&tid_lock, "tid");
+    for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+        list_init(&ready_queues[pri]);
+    ready_bitmap = 0;
+    ready_cnt = 0;
+    list_init(&charged_list);
     list_init(&destruction_req);
 
     /* Set up a thread structure for the running thread. */
@@ -280,9 +303,9 @@ void thread_unblock(struct thread* t)
 
     old_level = intr_disable();
     ASSERT(t->status == THREAD_BLOCKED);
-    // list_push_back (&ready_list, &t->elem);
-    // project1-2
-    list_insert_ordered(&ready_list, &t->elem, cmp_priority_more, NULL);
+    if (thread_mlfqs)
+        mlfqs_catch_up(t);
+    ready_push(t);
     t->status = THREAD_READY;
     intr_set_level(old_level);
 }
@@ -291,11 +314,10 @@ void thread_preempted(void)
 {
     if (thread_current() == idle_thread)
         return;
-    if (list_empty(&ready_list))
+    if (ready_bitmap == 0)
         return;
     struct thread* curr = thread_current();
-    struct thread* ready_front = list_entry(list_front(&ready_list), struct thread, elem);
-    if (curr->priority < ready_front->priority)
+    if (curr->priority < ready_max_priority())
         if (intr_context()) {
             intr_yield_on_return();
         } else
@@ -303,53 +325,27 @@ void thread_preempted(void)
 }
 
 /* Project 1 - Alarm Clock */
-/* thread의 awake를 설정 후 sleep_list에 넣고 block
-   sleep_list는 tick을 기준으로 정렬되어야 한다. */
+/* 현재 스레드를 TICK까지 재운다.
+   깨우는 시점은 timer 이벤트가 정하므로 O(log n)에 등록된다. */
 void thread_sleep(int64_t tick)
 {
+    struct thread* curr = thread_current();
     enum intr_level old_level;
     old_level = intr_disable();
 
-    ASSERT(thread_current() != idle_thread);
-    thread_current()->wake_time = tick;
-    list_insert_ordered(&sleep_list, &thread_current()->elem, cmp_awake_less, NULL);
+    ASSERT(curr != idle_thread);
+    timer_arm(&curr->wakeup, tick);
     thread_block();
     intr_set_level(old_level);
 }
 
-/* awake 비교 함수 */
-static bool cmp_awake_less(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED)
+/* timer 이벤트 콜백: 인터럽트 핸들러 안에서 잠든 스레드 T_를 깨운다. */
+static void thread_wakeup(void* t_)
 {
-    struct thread* ta = list_entry(a, struct thread, elem);
-    struct thread* tb = list_entry(b, struct thread, elem);
-    return ta->wake_time < tb->wake_time;
-}
-/*우선순위 비교 함수*/
-static bool cmp_priority_more(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED)
-{
-    struct thread* ta = list_entry(a, struct thread, elem);
-    struct thread* tb = list_entry(b, struct thread, elem);
-    return ta->priority > tb->priority;
-}
+    struct thread* t = t_;
 
-/* timer.c 의 timer_interrupt에 의해 매틱마다 실행
-   sleep_list를 앞에서부터 순회하며 충분히 잤으면 깨운다. */
-void thread_awake(int64_t ticks)
-{
-    enum intr_level old_level;
-    old_level = intr_disable();
-    struct list_elem* iter = list_begin(&sleep_list);
-    while (iter != list_end(&sleep_list)) {
-        struct thread* curr = list_entry(iter, struct thread, elem);
-        if (curr->wake_time <= ticks) {
-            iter = list_remove(iter);
-            thread_unblock(curr);
-            thread_preempted();
-        } else {
-            break;
-        }
-    }
-    intr_set_level(old_level);
+    thread_unblock(t);
+    thread_preempted();
 }
 /* ~Alarm Clock */
 
@@ -396,6 +392,10 @@ void thread_exit(void)
     /* Just set our status to dying and schedule another process.
        We will be destroyed during the call to schedule_tail(). */
     intr_disable();
+    if (thread_current()->charged) {
+        list_remove(&thread_current()->charged_elem);
+        thread_current()->charged = false;
+    }
     do_schedule(THREAD_DYING);
     NOT_REACHED();
 }
@@ -410,9 +410,8 @@ void thread_yield(void)
     ASSERT(!intr_context());
 
     old_level = intr_disable();
-    // project 1-2 우선순위 순으로 넣기
     if (curr != idle_thread)
-        list_insert_ordered(&ready_list, &curr->elem, cmp_priority_more, NULL);
+        ready_push(curr);
     do_schedule(THREAD_READY);
     intr_set_level(old_level);
 }
@@ -433,6 +432,27 @@ int thread_get_priority(void)
     return thread_current()->priority;
 }
 
+/* Sets T's effective priority to PRIORITY.  A thread on the run
+   queue is moved to the tail of its new priority's queue, so
+   donation and the advanced scheduler may change the priority of
+   any thread, not only the running one. */
+void thread_set_effective_priority(struct thread* t, int priority)
+{
+    enum intr_level old_level;
+
+    ASSERT(is_thread(t));
+    ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+    old_level = intr_disable();
+    if (t->status == THREAD_READY && t->priority != priority) {
+        ready_remove(t);
+        t->priority = priority;
+        ready_push(t);
+    } else
+        t->priority = priority;
+    intr_set_level(old_level);
+}
+
 /* ~Priority Scheduling */
 
 /* Project 1 - Advanced Scheduler */
@@ -475,41 +495,81 @@ int thread_get_recent_cpu(void)
     return ret_recent_cpu;
 }
 
-void cal_priority(struct thread* t)
+/* Returns the advanced scheduler's priority for T. */
+static int mlfqs_priority(const struct thread* t)
 {
-    if (t != idle_thread) {
-        // priority = PRI_MAX - (recent_cpu / 4) - (nice * 2),
-        // type: 17.14 fp
-        int priority_fp = int_to_fp(PRI_MAX) - div_fp_int(t->recent_cpu, 4) - int_to_fp(t->nice * 2);
+    // priority = PRI_MAX - (recent_cpu / 4) - (nice * 2),
+    // type: 17.14 fp
+    int priority_fp = int_to_fp(PRI_MAX) - div_fp_int(t->recent_cpu, 4) - int_to_fp(t->nice * 2);
 
-        int priority_int = fp_to_int_round_near(priority_fp);
-        if (priority_int < PRI_MIN)
-            priority_int = PRI_MIN;
-        if (priority_int > PRI_MAX)
-            priority_int = PRI_MAX;
+    int priority_int = fp_to_int_round_near(priority_fp);
+    if (priority_int < PRI_MIN)
+        priority_int = PRI_MIN;
+    if (priority_int > PRI_MAX)
+        priority_int = PRI_MAX;
+    return priority_int;
+}
 
-        t->actual_priority = priority_int;
-        t->priority = t->actual_priority;
+void cal_priority(struct thread* t)
+{
+    if (t != idle_thread) {
+        t->actual_priority = mlfqs_priority(t);
+        thread_set_effective_priority(t, t->actual_priority);
     }
 }
 
-void cal_recent_cpu(struct thread* t)
+/* Applies one second's decay, with coefficient COEF, to T's
+   recent_cpu. */
+void cal_recent_cpu(struct thread* t, int coef)
 {
     if (t != idle_thread) {
         // recent_cpu = (2 * load_avg)/(2 * load_avg + 1) * recent_cpu + nice
         // type: 17.14 fp
-        int expr_1 = mul_fp_int(load_avg, 2);
-        int expr_2 = add_fp_int(mul_fp_int(load_avg, 2), 1);
-        int recent_cpu_fp = add_fp_int((mul_fp(div_fp(expr_1, expr_2), t->recent_cpu)), t->nice);
-        // type: 17.14 fp
-        t->recent_cpu = recent_cpu_fp;
+        t->recent_cpu = add_fp_int(mul_fp(coef, t->recent_cpu), t->nice);
+    }
+    t->decay_epoch = decay_epoch;
+}
+
+/* Brings the recent_cpu and priority of T, which is about to
+   become ready, up to date with the seconds that passed while it
+   was blocked.  Only the last DECAY_LOG coefficients are kept; any
+   older seconds are assumed to have used the oldest one kept, which
+   admits the closed form
+       r' = c^n * r + nice * (1 - c^n) / (1 - c). */
+static void mlfqs_catch_up(struct thread* t)
+{
+    unsigned missed = decay_epoch - t->decay_epoch;
+
+    if (missed == 0 || t == idle_thread)
+        return;
+
+    if (t->recent_cpu == 0 && t->nice == 0) {
+        /* A fixed point of the decay. */
+        t->decay_epoch = decay_epoch;
+        return;
+    }
+
+    if (missed > DECAY_LOG) {
+        int coef = decay_coef[decay_epoch % DECAY_LOG];
+        int coef_n = pow_fp(coef, missed - DECAY_LOG);
+
+        t->recent_cpu = add_fp(mul_fp(coef_n, t->recent_cpu),
+                               mul_fp_int(div_fp(sub_fp(int_to_fp(1), coef_n), sub_fp(int_to_fp(1), coef)), t->nice));
+        t->decay_epoch = decay_epoch - DECAY_LOG;
     }
+    while (t->decay_epoch != decay_epoch) {
+        int coef = decay_coef[t->decay_epoch % DECAY_LOG];
+        t->recent_cpu = add_fp_int(mul_fp(coef, t->recent_cpu), t->nice);
+        t->decay_epoch++;
+    }
+
+    t->actual_priority = t->priority = mlfqs_priority(t);
 }
 
 void cal_load_avg(void)
 {
     // load_avg = (59/60) * load_avg + (1/60) * ready_threads
-    int ready_threads = list_size(&ready_list);
+    int ready_threads = ready_cnt;
     if (thread_current() != idle_thread)
         ready_threads += 1;
     // type: 17.14 fp
@@ -519,44 +579,61 @@ void cal_load_avg(void)
     load_avg = add_fp(expr_1, expr_2);
 }
 
+/* Recomputes the priority of every thread charged a tick since the
+   last call.  No other thread's inputs have changed. */
 void update_priority(void)
 {
-    struct list_elem* e;
-
-    cal_priority(thread_current());
-
-    for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, elem);
-        cal_priority(t);
-    }
-
-    for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, elem);
+    while (!list_empty(&charged_list)) {
+        struct thread* t = list_entry(list_pop_front(&charged_list), struct thread, charged_elem);
+        t->charged = false;
         cal_priority(t);
     }
 }
 
+/* Charges the running thread one tick of recent_cpu. */
 void incr_recent_cpu(void)
 {
-    if (thread_current() != idle_thread) {
-        thread_current()->recent_cpu = add_fp_int(thread_current()->recent_cpu, 1);
+    struct thread* curr = thread_current();
+
+    if (curr != idle_thread) {
+        curr->recent_cpu = add_fp_int(curr->recent_cpu, 1);
+        if (!curr->charged) {
+            curr->charged = true;
+            list_push_back(&charged_list, &curr->charged_elem);
+        }
     }
 }
 
+/* Decays recent_cpu at a second boundary.  Must follow
+   cal_load_avg().  Only the running thread and the ready threads
+   are decayed now, since their priorities decide who runs next;
+   blocked threads catch up in thread_unblock().  The run queue is
+   drained in scheduling order and refilled, so threads that keep
+   their priority also keep their place in line. */
 void update_recent_cpu(void)
 {
-    struct list_elem* e;
+    // type: 17.14 fp
+    int coef = div_fp(mul_fp_int(load_avg, 2), add_fp_int(mul_fp_int(load_avg, 2), 1));
+    struct list ready;
 
-    cal_recent_cpu(thread_current());
+    decay_coef[decay_epoch % DECAY_LOG] = coef;
+    decay_epoch++;
 
-    for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, elem);
-        cal_recent_cpu(t);
-    }
+    cal_recent_cpu(thread_current(), coef);
+    cal_priority(thread_current());
 
-    for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, elem);
-        cal_recent_cpu(t);
+    list_init(&ready);
+    for (int pri = PRI_MAX; pri >= PRI_MIN; pri--)
+        while (!list_empty(&ready_queues[pri]))
+            list_push_back(&ready, list_pop_front(&ready_queues[pri]));
+    ready_bitmap = 0;
+    ready_cnt = 0;
+
+    while (!list_empty(&ready)) {
+        struct thread* t = list_entry(list_pop_front(&ready), struct thread, elem);
+        cal_recent_cpu(t, coef);
+        t->actual_priority = t->priority = mlfqs_priority(t);
+        ready_push(t);
     }
 }
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -623,6 +700,7 @@ static void init_thread(struct thread* t, const char* name, int priority)
     t->tf.rsp = (uint64_t)t + PGSIZE - sizeof(void*);
     t->priority = priority;
     t->magic = THREAD_MAGIC;
+    timer_event_init(&t->wakeup, thread_wakeup, t);
 
     // project 1-3 donation
     t->actual_priority = priority;
@@ -630,6 +708,7 @@ static void init_thread(struct thread* t, const char* name, int priority)
     // project 1-4 advanced
     t->nice = NICE_DEFAULT;
     t->recent_cpu = RECENT_CPU_DEFAULT;
+    t->decay_epoch = decay_epoch;
     // project 2 가능 디스크립터 초기값
 
 #ifdef USERPROG
@@ -653,10 +732,43 @@ static void init_thread(struct thread* t, const char* name, int priority)
    idle_thread. */
 static struct thread* next_thread_to_run(void)
 {
-    if (list_empty(&ready_list))
+    if (ready_bitmap == 0)
         return idle_thread;
-    else
-        return list_entry(list_pop_front(&ready_list), struct thread, elem);
+    else {
+        struct thread* t = list_entry(list_front(&ready_queues[ready_max_priority()]), struct thread, elem);
+        ready_remove(t);
+        return t;
+    }
+}
+
+/* Appends T to the run queue for its priority.  Interrupts must
+   be off. */
+static void ready_push(struct thread* t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    list_push_back(&ready_queues[t->priority], &t->elem);
+    ready_bitmap |= 1ULL << (PRI_MAX - t->priority);
+    ready_cnt++;
+}
+
+/* Removes T from the run queue.  Interrupts must be off. */
+static void ready_remove(struct thread* t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    list_remove(&t->elem);
+    if (list_empty(&ready_queues[t->priority]))
+        ready_bitmap &= ~(1ULL << (PRI_MAX - t->priority));
+    ready_cnt--;
+}
+
+/* Returns the highest priority on the run queue, which must not
+   be empty. */
+static int ready_max_priority(void)
+{
+    ASSERT(ready_bitmap != 0);
+    return PRI_MAX - (__builtin_ffsll(ready_bitmap) - 1);
 }
 
 /* Use iretq to launch the thread */
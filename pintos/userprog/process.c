@@ -259,9 +259,7 @@ int process_exec(void* f_name)
     process_cleanup();
 
     /* And then load the binary */
-    lock_acquire(&filesys_lock);
     success = load(file_name, &_if);
-    lock_release(&filesys_lock);
 
     /* If load failed, quit. */
     palloc_free_page(file_name);
@@ -736,28 +734,146 @@ static bool install_page(void* upage, void* kpage, bool writable)
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Pages around a faulting segment page that are read in along with it:
+ * the aligned 64 kB window that contains it. */
+#define SEGMENT_WINDOW 16
+
+/* Number of file bytes that belong to the page of SEG at UPAGE. */
+size_t lazy_segment_read_bytes(const struct lazy_segment* seg, const uint8_t* upage)
+{
+    size_t page_ofs = upage - seg->upage;
+
+    if (page_ofs >= seg->read_bytes)
+        return 0;
+    return seg->read_bytes - page_ofs < PGSIZE ? seg->read_bytes - page_ofs : PGSIZE;
+}
+
+/* Add a reference to SEG, for a page that points to it. */
+void lazy_segment_get(struct lazy_segment* seg)
+{
+    enum intr_level old_level = intr_disable();
+    seg->ref_cnt++;
+    intr_set_level(old_level);
+}
+
+/* Drop a reference to SEG, freeing it with the last one. Fork shares
+ * SEG between processes, so the count is updated with interrupts off. */
+void lazy_segment_put(struct lazy_segment* seg)
+{
+    enum intr_level old_level = intr_disable();
+    bool last = --seg->ref_cnt == 0;
+    intr_set_level(old_level);
+
+    if (last) {
+        file_close(seg->file);
+        free(seg);
+    }
+}
+
+/* If the page of SEG at UPAGE in OWNER's address space has not been
+ * touched yet, store it in *PAGEP along with a free frame for it in
+ * *FRAMEP and return true. */
+static bool segment_claim_neighbour(struct lazy_segment* seg, struct thread* owner, uint8_t* upage,
+                                    struct page** pagep, struct frame** framep)
+{
+    struct page* p;
+    struct frame* frame;
+
+    /* 같은 segment에서 아직 읽지 않은 파일 페이지만 */
+    if (upage < seg->upage || lazy_segment_read_bytes(seg, upage) == 0)
+        return false;
+    p = spt_find_page(&owner->spt, upage);
+    if (p == NULL || VM_TYPE(p->operations->type) != VM_UNINIT || p->uninit.aux != seg)
+        return false;
+    frame = vm_get_free_frame();
+    if (frame == NULL)
+        return false;
+    *pagep = p;
+    *framep = frame;
+    return true;
+}
+
+/* Read PAGE of SEG, whose frame has just been claimed, together with the
+ * untouched pages of SEG next to it in its aligned window, so that
+ * running through the text does not take a fault per page. The pages
+ * are consecutive in the file, so their range is read with a single
+ * file_read_at() into a bounce buffer and then copied to each frame.
+ * Only free frames are used for the neighbours; nothing is evicted for
+ * the sake of a guess. */
+static bool segment_read_window(struct lazy_segment* seg, struct page* page)
+{
+    struct thread* owner = page->accessible_thread;
+    uint8_t* start = (uint8_t*)((uint64_t)page->va & ~((uint64_t)SEGMENT_WINDOW * PGSIZE - 1));
+    struct page* pages[SEGMENT_WINDOW];
+    struct frame* frames[SEGMENT_WINDOW];
+    size_t fault_idx = ((uint8_t*)page->va - start) / PGSIZE;
+    size_t lo = fault_idx, hi = fault_idx + 1;
+    size_t read_bytes, i;
+    uint8_t* buf = NULL;
+    bool success;
+
+    pages[fault_idx] = page;
+    frames[fault_idx] = page->frame;
+    if (owner != NULL) {
+        while (lo > 0 && segment_claim_neighbour(seg, owner, start + (lo - 1) * PGSIZE, &pages[lo - 1], &frames[lo - 1]))
+            lo--;
+        while (hi < SEGMENT_WINDOW && segment_claim_neighbour(seg, owner, start + hi * PGSIZE, &pages[hi], &frames[hi]))
+            hi++;
+    }
+    if (hi - lo > 1) {
+        buf = palloc_get_multiple(0, hi - lo);
+        if (buf == NULL) {
+            /* 버퍼가 없으면 이웃은 포기하고 폴트 난 페이지만 읽음 */
+            for (i = lo; i < hi; i++)
+                if (i != fault_idx)
+                    vm_free_frame(frames[i]);
+            lo = fault_idx;
+            hi = fault_idx + 1;
+        }
+    }
+
+    /* 마지막 페이지만 PGSIZE보다 짧을 수 있으므로 파일 범위는 연속 */
+    read_bytes = 0;
+    for (i = lo; i < hi; i++)
+        read_bytes += lazy_segment_read_bytes(seg, start + i * PGSIZE);
+    success = file_read_at(seg->file, buf != NULL ? buf : frames[fault_idx]->kva, read_bytes,
+                           seg->ofs + (start + lo * PGSIZE - seg->upage)) == (int)read_bytes;
+
+    for (i = lo; i < hi; i++) {
+        uint8_t* kva = frames[i]->kva;
+        size_t page_read_bytes = lazy_segment_read_bytes(seg, start + i * PGSIZE);
+
+        if (success) {
+            if (buf != NULL)
+                memcpy(kva, buf + (i - lo) * PGSIZE, page_read_bytes);
+            memset(kva + page_read_bytes, 0, PGSIZE - page_read_bytes);
+        }
+        /* PAGE의 프레임은 vm_do_claim_page()가 매핑하거나 회수 */
+        if (i == fault_idx)
+            continue;
+        if (!success)
+            vm_free_frame(frames[i]);
+        else if (vm_map_prefetched(pages[i], frames[i]))
+            lazy_segment_put(seg);
+    }
+    if (buf != NULL)
+        palloc_free_multiple(buf, hi - lo);
+    return success;
+}
+
 static bool lazy_load_segment(struct page* page, void* aux)
 {
     /* TODO: Load the segment from the file */
     /* TODO: This called when the first page fault occurs on address VA. */
     /* TODO: VA is available when calling this function. */
-    struct lazy_load_aux* arg = (struct lazy_load_aux*)aux;
-    bool flag = false;
-    if (!lock_held_by_current_thread(&filesys_lock)) {
-        lock_acquire(&filesys_lock);
-        flag = true;
-    }
-    if (file_read_at(arg->file, page->frame->kva, arg->page_read_bytes, arg->ofs) != (int)arg->page_read_bytes) {
-        if (flag)
-            lock_release(&filesys_lock);
-        palloc_free_page(page->frame->kva);
-        return false;
-    }
-    if (flag)
-        lock_release(&filesys_lock);
-    memset(page->frame->kva + arg->page_read_bytes, 0, arg->page_zero_bytes);
-    free(aux);
-    return true;
+    struct lazy_segment* seg = aux;
+    bool success;
+
+    /* 실패 시 프레임은 vm_do_claim_page()가 회수 */
+    success = segment_read_window(seg, page);
+    /* PAGE는 이미 anon 페이지: 성공 여부와 상관없이 참조 반납 */
+    lazy_segment_put(seg);
+    return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -772,33 +888,62 @@ static bool lazy_load_segment(struct page* page, void* aux)
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * Pages with file data share one lazy_segment that describes the
+ * whole segment; pages that are all zero are plain demand-zero
+ * anonymous pages. Read-only pages with file data are text pages,
+ * shared with every other process running the same executable.
+ *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
 static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t read_bytes, uint32_t zero_bytes,
                          bool writable)
 {
+    struct lazy_segment* seg = NULL;
+
     ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
     ASSERT(pg_ofs(upage) == 0);
     ASSERT(ofs % PGSIZE == 0);
 
+    if (read_bytes > 0) {
+        seg = malloc(sizeof *seg);
+        if (seg == NULL)
+            return false;
+        /* 부모가 먼저 exit해도 fork된 자식이 계속 읽을 수 있도록 별도 핸들 */
+        seg->file = file_reopen(file);
+        if (seg->file == NULL) {
+            free(seg);
+            return false;
+        }
+        seg->ofs = ofs;
+        seg->upage = upage;
+        seg->read_bytes = read_bytes;
+        /* 만드는 동안의 참조 하나, 마지막에 반납 */
+        seg->ref_cnt = 1;
+    }
+
     while (read_bytes > 0 || zero_bytes > 0) {
         /* Do calculate how to fill this page.
          * We will read PAGE_READ_BYTES bytes from FILE
          * and zero the final PAGE_ZERO_BYTES bytes. */
         size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
         size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-        /* TODO: Set up aux to pass information to the lazy_load_segment. */
-        struct lazy_load_aux* lazy_load_aux = malloc(sizeof(struct lazy_load_aux));
-        if (lazy_load_aux == NULL)
-            return false;
-        lazy_load_aux->file = file;
-        lazy_load_aux->ofs = ofs;
-        lazy_load_aux->page_read_bytes = page_read_bytes;
-        lazy_load_aux->page_zero_bytes = page_zero_bytes;
-
-        if (!vm_alloc_page_with_initializer(VM_ANON, upage, writable, lazy_load_segment, lazy_load_aux)) {
-            free(lazy_load_aux);
+        bool success;
+
+        if (page_read_bytes == 0)
+            success = vm_alloc_page(VM_ANON, upage, writable);
+        else {
+            /* 읽기 전용 segment는 같은 실행 파일을 돌리는 프로세스끼리 text cache로 공유 */
+            lazy_segment_get(seg);
+            if (writable)
+                success = vm_alloc_page_with_initializer(VM_ANON, upage, true, lazy_load_segment, seg);
+            else
+                success = vm_alloc_page_with_initializer(VM_TEXT, upage, false, NULL, seg);
+            if (!success)
+                lazy_segment_put(seg);
+        }
+        if (!success) {
+            if (seg != NULL)
+                lazy_segment_put(seg);
             return false;
         }
 
@@ -806,8 +951,9 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
         read_bytes -= page_read_bytes;
         zero_bytes -= page_zero_bytes;
         upage += PGSIZE;
-        ofs += page_read_bytes;
     }
+    if (seg != NULL)
+        lazy_segment_put(seg);
     return true;
 }
 
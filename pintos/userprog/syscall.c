@@ -21,8 +21,6 @@
 void syscall_entry(void);
 void syscall_handler(struct intr_frame*);
 
-struct lock filesys_lock;
-
 // int write (int fd, const void *buffer, unsigned size)
 // {
 // 	char f_buffer[size+1];
@@ -52,7 +50,6 @@ void syscall_init(void)
      * until the syscall_entry swaps the userland stack to the kernel
      * mode stack. Therefore, we masked the FLAG_FL. */
     write_msr(MSR_SYSCALL_MASK, FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-    lock_init(&filesys_lock);
 }
 
 /*fd 비교 함수*/
@@ -144,14 +141,10 @@ static void user_memory_access(const void* addr)
 static bool create(const char* file, unsigned initial_size)
 {
     user_memory_access(file);
-    lock_acquire(&filesys_lock);
-    if (filesys_create(file, initial_size)) {
-        lock_release(&filesys_lock);
+    if (filesys_create(file, initial_size))
         return TRUE;
-    } else {
-        lock_release(&filesys_lock);
+    else
         return FALSE;
-    }
 }
 
 static void close(int fd)
@@ -166,16 +159,12 @@ static int open(const char* file_name)
     struct thread* curr = thread_current();
     int fd;
     user_memory_access(file_name);
-    lock_acquire(&filesys_lock);
     file = filesys_open(file_name);
-    if (file == NULL) {
-        lock_release(&filesys_lock);
+    if (file == NULL)
         return -1;
-    }
     fd = find_pos_fd_num(curr);
     if (fd == -1) {
         file_close(file);
-        lock_release(&filesys_lock);
         return -1;
     }
     struct descriptor* descript = calloc(1, sizeof(struct descriptor));
@@ -187,7 +176,6 @@ static int open(const char* file_name)
     descript->file = file;
     descript->file->refcnt++;
     list_insert_ordered(&(curr->descrs_t), &(descript->desc_elem), cmp_fd_less, NULL);
-    lock_release(&filesys_lock);
     return fd;
 }
 
@@ -208,12 +196,8 @@ static int read(int fd, void* buffer, unsigned size)
     }
     if (file == NULL)
         return -1;
-    if (file != stdin_f && file != stdout_f) {
-        lock_acquire(&filesys_lock);
-        int bytes = file_read(file, buffer, size);
-        lock_release(&filesys_lock);
-        return bytes;
-    }
+    if (file != stdin_f && file != stdout_f)
+        return file_read(file, buffer, size);
     if (file == stdin_f) {
         char* ptr = (char*)buffer;
         int bytes = 0;
@@ -240,10 +224,7 @@ static int write(int fd, void* buffer, unsigned size)
     if (file != stdin_f && file != stdout_f) {
         if (file->deny_write)
             return 0;
-        lock_acquire(&filesys_lock);
-        int bytes = file_write(file, buffer, size);
-        lock_release(&filesys_lock);
-        return bytes;
+        return file_write(file, buffer, size);
     }
 
     if (file == stdout_f) {
@@ -4,10 +4,13 @@
 #include "threads/thread.h"
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "bitmap.h"
+#include "string.h"
 #include <stdint.h>
 #define SECTOR_PER_PAGE 8
+#define SWAP_CLUSTER 8 /* Max pages moved by one swap I/O command. */
 /* DO NOT MODIFY BELOW LINE */
 static struct disk* swap_disk;
 static bool anon_swap_in(struct page* page, void* kva);
@@ -23,7 +26,14 @@ static const struct page_operations anon_ops = {
 };
 
 static struct bitmap* swap_table;
-static struct lock swap_lock;
+static uint16_t* swap_refs;       /* Pages referring to each slot. */
+static struct spinlock swap_lock; /* Protects swap_table, swap_refs and swap_hint. */
+static size_t swap_hint;     /* Next-fit start for slot allocation. */
+static uint8_t* swap_buf;    /* Bounce buffer for SWAP_CLUSTER pages. */
+static struct lock swap_io_lock; /* Protects swap_buf. */
+
+static size_t swap_alloc(struct page* page, size_t cnt);
+static void swap_free(size_t slot_idx);
 
 /* Initialize the data for anonymous pages */
 void vm_anon_init(void)
@@ -33,7 +43,88 @@ void vm_anon_init(void)
     swap_disk = disk_get(1, 1); // disk.c의 line 182: 1:1 - swap
     size_t total_slot_cnt = disk_size(swap_disk) / SECTOR_PER_PAGE; // 1slot = 8sectors(1sector = 512bytes)
     swap_table = bitmap_create(total_slot_cnt); // bitmap으로 swap table 관리
-    lock_init(&swap_lock); // filesys_lock과 별개로 swap_lock 생성, disk가 다름, bitmap_ 함수 전용 lock(slot race condition 방지)
+    swap_refs = calloc(total_slot_cnt, sizeof *swap_refs); // 쫓겨난 COW 프레임은 slot 하나를 여럿이 공유
+    if (swap_table == NULL || swap_refs == NULL)
+        PANIC("vm_anon_init: out of memory");
+    spinlock_init(&swap_lock); // bitmap_ 함수 전용, 몇 개 명령어뿐이라 잠들지 않고 spin
+    swap_hint = 0;
+    swap_buf = palloc_get_multiple(PAL_ASSERT, SWAP_CLUSTER);
+    lock_init(&swap_io_lock);
+    lock_register(&swap_io_lock, "swap io");
+}
+
+/* Allocate a run of CNT contiguous slots for PAGE and the pages that
+ * follow it. The run is placed right after the slot of PAGE's virtual
+ * predecessor when possible, so neighbours in memory stay neighbours on
+ * disk and can be read back with one command. PAGE may be a null pointer.
+ * Returns SIZE_MAX (BITMAP_ERROR) if no such run exists. */
+static size_t swap_alloc(struct page* page, size_t cnt)
+{
+    size_t hint = swap_hint;
+    size_t slot_idx;
+
+    if (page != NULL && page->accessible_thread == thread_current()) {
+        struct page* prev = spt_find_page(&page->accessible_thread->spt, page->va - PGSIZE);
+        if (prev != NULL && prev->operations == &anon_ops && prev->anon.slot_idx != SIZE_MAX)
+            hint = prev->anon.slot_idx + 1;
+    }
+
+    spinlock_acquire(&swap_lock);
+    slot_idx = bitmap_scan_and_flip(swap_table, hint, cnt, false);
+    if (slot_idx == BITMAP_ERROR && hint != 0)
+        slot_idx = bitmap_scan_and_flip(swap_table, 0, cnt, false);
+    if (slot_idx != BITMAP_ERROR) {
+        swap_hint = slot_idx + cnt;
+        for (size_t i = 0; i < cnt; i++)
+            swap_refs[slot_idx + i] = 1;
+    }
+    spinlock_release(&swap_lock);
+    return slot_idx;
+}
+
+/* Drop a reference to swap slot SLOT_IDX, releasing it with the last. */
+static void swap_free(size_t slot_idx)
+{
+    spinlock_acquire(&swap_lock);
+    ASSERT(swap_refs[slot_idx] > 0);
+    if (--swap_refs[slot_idx] == 0)
+        bitmap_reset(swap_table, slot_idx);
+    spinlock_release(&swap_lock);
+}
+
+/* Write the page at KVA, a frame shared copy-on-write whose mappings
+ * have all been cleared, to a new swap slot and return the slot. The
+ * caller holds the slot's only reference; see anon_share_slot() and
+ * anon_put_slot(). */
+size_t anon_swap_out_shared(void* kva)
+{
+    size_t slot_idx = swap_alloc(NULL, 1);
+
+    if (slot_idx == BITMAP_ERROR)
+        PANIC("swap disk is full");
+
+    disk_write_multi(swap_disk, slot_idx * SECTOR_PER_PAGE, SECTOR_PER_PAGE, kva);
+    return slot_idx;
+}
+
+/* Make PAGE, which has just lost its frame, refer to swap slot
+ * SLOT_IDX. */
+void anon_share_slot(struct page* page, size_t slot_idx)
+{
+    ASSERT(page->operations == &anon_ops);
+    ASSERT(page->anon.slot_idx == SIZE_MAX);
+
+    spinlock_acquire(&swap_lock);
+    swap_refs[slot_idx]++;
+    spinlock_release(&swap_lock);
+    page->anon.slot_idx = slot_idx;
+}
+
+/* Drop the reference to swap slot SLOT_IDX that
+ * anon_swap_out_shared() returned. */
+void anon_put_slot(size_t slot_idx)
+{
+    swap_free(slot_idx);
 }
 
 /* Initialize the file mapping */
@@ -44,43 +135,124 @@ bool anon_initializer(struct page* page, enum vm_type type, void* kva)
 
     struct anon_page* anon_page = &page->anon;
     anon_page->slot_idx = SIZE_MAX; // slot index 설정(unsigned라서 -1 대신 SIZE_MAX 사용)
+    anon_page->huge = false;
     return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by read contents from the swap disk.
+ * Pages that follow PAGE in memory and were swapped out to the following
+ * slots are read in by the same command and mapped into free frames. */
 static bool anon_swap_in(struct page* page, void* kva)
 {
     struct anon_page* anon_page = &page->anon;
     size_t slot_idx = anon_page->slot_idx;
+    struct page* cluster[SWAP_CLUSTER];
+    size_t cnt = 1;
+
     if (slot_idx == SIZE_MAX)
         return false;
-    // sector 단위로 읽기 때문에 8을 곱하고, sector_size만큼 버퍼 크기 증가, disk 함수는 lock 내부에서 동기화 처리, 따라서 별도 lock 불필요
-    for (size_t i = 0; i < SECTOR_PER_PAGE; i++) 
-        disk_read(swap_disk, slot_idx * SECTOR_PER_PAGE + i, (uint8_t*)kva + i * DISK_SECTOR_SIZE);
+
+    // 가상주소상 뒤따르는 페이지들이 연속된 slot에 있으면 한 번에 읽음(read-ahead)
+    // swap in은 소유자 또는 fork 중인 자식(부모는 대기 중)만 수행하므로 spt 접근이 안전
+    struct supplemental_page_table* spt = &page->accessible_thread->spt;
+    for (; cnt < SWAP_CLUSTER; cnt++) {
+        struct page* next = spt_find_page(spt, page->va + cnt * PGSIZE);
+        if (next == NULL || next->operations != &anon_ops || next->frame != NULL ||
+            next->anon.slot_idx != slot_idx + cnt)
+            break;
+        cluster[cnt] = next;
+    }
+
+    if (cnt == 1) {
+        // disk 함수는 lock 내부에서 동기화 처리, 따라서 별도 lock 불필요
+        disk_read_multi(swap_disk, slot_idx * SECTOR_PER_PAGE, SECTOR_PER_PAGE, kva);
+    } else {
+        lock_acquire(&swap_io_lock);
+        disk_read_multi(swap_disk, slot_idx * SECTOR_PER_PAGE, cnt * SECTOR_PER_PAGE, swap_buf);
+        memcpy(kva, swap_buf, PGSIZE);
+        for (size_t i = 1; i < cnt; i++) {
+            // read-ahead는 다른 페이지를 evict 하지 않음: 빈 프레임이 없으면 중단
+            struct frame* frame = vm_get_free_frame();
+            if (frame == NULL)
+                break;
+            memcpy(frame->kva, swap_buf + i * PGSIZE, PGSIZE);
+            if (!vm_map_frame(cluster[i], frame))
+                break;
+            swap_free(cluster[i]->anon.slot_idx);
+            cluster[i]->anon.slot_idx = SIZE_MAX;
+        }
+        lock_release(&swap_io_lock);
+    }
     // read 실패처리는 반환 값이 없으므로 따로 하지 않음
-    // swap in을 했으니, 해당 slot을 비워줌, slot 접근은 lock 필요
-    lock_acquire(&swap_lock);
-    bitmap_reset(swap_table, slot_idx);
-    lock_release(&swap_lock);
+    // swap in을 했으니, 해당 slot을 비워줌
+    swap_free(slot_idx);
     anon_page->slot_idx = SIZE_MAX; // slot index 초기화
     return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk.
+ * When the evicting thread owns PAGE, cold pages that follow it in memory
+ * are written out with it to a contiguous slot run by one command.
+ * The mappings are torn down before the contents are copied or the
+ * write is submitted, so that the owner cannot change a page behind the
+ * write's back; the frames of the cluster are released while the disk
+ * works. */
 static bool anon_swap_out(struct page* page)
 {
-    struct anon_page* anon_page = &page->anon;
-    lock_acquire(&swap_lock);
-    size_t slot_idx = bitmap_scan_and_flip(swap_table, 0, 1, false); // 빈 slot 찾기 및 할당
-    lock_release(&swap_lock);
-    if (slot_idx == SIZE_MAX)
+    struct thread* owner = page->accessible_thread;
+    struct page* cluster[SWAP_CLUSTER] = {page};
+    struct disk_request req;
+    size_t cnt = 1;
+    size_t slot_idx;
+
+    // 다른 프로세스의 spt는 동기화 없이 볼 수 없으므로 소유자가 evict 할 때만 묶어서 내보냄
+    if (owner == thread_current()) {
+        for (; cnt < SWAP_CLUSTER; cnt++) {
+            struct page* next = spt_find_page(&owner->spt, page->va + cnt * PGSIZE);
+            if (next == NULL || next->operations != &anon_ops || !vm_isolate_page(next))
+                break;
+            cluster[cnt] = next;
+        }
+    }
+
+    slot_idx = swap_alloc(page, cnt); // 연속된 빈 slot 찾기 및 할당
+    if (slot_idx == BITMAP_ERROR && cnt > 1) {
+        // 연속 구간이 없으면 묶음을 풀고 한 페이지만
+        while (cnt > 1)
+            vm_unpin_frame(cluster[--cnt]->frame);
+        slot_idx = swap_alloc(page, 1);
+    }
+    if (slot_idx == BITMAP_ERROR)
         PANIC("swap disk is full");
-    // sector 단위로 쓰기 때문에 8을 곱하고, sector_size만큼 버퍼 크기 증가, disk 함수는 lock 내부에서 동기화 처리, 따라서 별도 lock 불필요
-    for (size_t i = 0; i < SECTOR_PER_PAGE; i++) 
-        disk_write(swap_disk, slot_idx * SECTOR_PER_PAGE + i, (uint8_t*)page->frame->kva + i * DISK_SECTOR_SIZE);
+
+    // 소유자가 다른 프로세스면 지금도 실행 중일 수 있음: 쓰기 전에 매핑부터 해제
+    for (size_t i = 0; i < cnt; i++)
+        pml4_clear_page(owner->pml4, cluster[i]->va);
+
+    if (cnt == 1) {
+        disk_request_init(&req, swap_disk, slot_idx * SECTOR_PER_PAGE, SECTOR_PER_PAGE, page->frame->kva, true, NULL,
+                          NULL);
+    } else {
+        lock_acquire(&swap_io_lock);
+        for (size_t i = 0; i < cnt; i++)
+            memcpy(swap_buf + i * PGSIZE, cluster[i]->frame->kva, PGSIZE);
+        disk_request_init(&req, swap_disk, slot_idx * SECTOR_PER_PAGE, cnt * SECTOR_PER_PAGE, swap_buf, true, NULL,
+                          NULL);
+    }
+    // 쓰기가 진행되는 동안 묶음 페이지의 프레임을 반환: 내용은 이미 swap_buf에 있음
+    // 같은 slot을 읽는 요청은 disk queue에서 이 쓰기를 앞지르지 않음
+    disk_submit(&req);
+    for (size_t i = 1; i < cnt; i++) {
+        struct frame* frame = cluster[i]->frame;
+        cluster[i]->anon.slot_idx = slot_idx + i;
+        cluster[i]->frame = NULL;
+        vm_free_evicted_frame(frame);
+    }
+    page->anon.slot_idx = slot_idx; // slot index 저장
     // write 실패처리는 반환 값이 없으므로 따로 하지 않음
-    anon_page->slot_idx = slot_idx; // slot index 저장
-    pml4_clear_page(page->accessible_thread->pml4, page->va); // 페이지 매핑 해제
+    disk_wait(&req);
+    if (cnt > 1)
+        lock_release(&swap_io_lock);
     page->frame = NULL;
     return true;
 }
@@ -90,23 +262,22 @@ static void anon_destroy(struct page* page)
 {
     struct anon_page* anon_page = &page->anon;
     struct thread* cur = thread_current();
-    
+
+    /* pageoutd가 swap out 하는 중이면 slot이 정해질 때까지 기다림 */
+    vm_wait_eviction(page);
+
     /* frame이 할당되어 있으면 해제 */
     if (page->frame != NULL)
     {
         /* pml4에서 매핑 해제 (pml4_destroy에서 double free 방지) */
         pml4_clear_page(cur->pml4, page->va);
-        page->frame->page = NULL; // vm_free_frame의 ASSERT 통과용
-        vm_free_frame(page->frame);
-        page->frame = NULL;
+        vm_release_frame(page); // copy-on-write 공유 중이면 참조만 감소
     }
 
     if (anon_page->slot_idx != SIZE_MAX)
     {
         /* swap slot 해제 */
-        lock_acquire(&swap_lock);
-        bitmap_reset(swap_table, anon_page->slot_idx);
-        lock_release(&swap_lock);
+        swap_free(anon_page->slot_idx);
         anon_page->slot_idx = SIZE_MAX;
     }
 }
@@ -3,6 +3,7 @@
 #include "vm/vm.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "threads/interrupt.h"
 #include "threads/mmu.h"
 #include "threads/malloc.h"
 #include <string.h>
@@ -54,14 +55,10 @@ bool file_backed_initializer(struct page* page, enum vm_type type, void* kva)
 static bool file_backed_swap_in(struct page* page, void* kva)
 {
     struct file_page* file_page UNUSED = &page->file;
-    bool success = false;
-    lock_acquire(&filesys_lock);
-    if (file_read_at(file_page->file, kva, file_page->length, file_page->offset) == (off_t)file_page->length) {
-        memset(kva + file_page->length, 0, PGSIZE - file_page->length);
-        success = true;
-    }
-    lock_release(&filesys_lock);
-    return success;
+    if (file_read_at(file_page->file, kva, file_page->length, file_page->offset) != (off_t)file_page->length)
+        return false;
+    memset(kva + file_page->length, 0, PGSIZE - file_page->length);
+    return true;
 }
 
 /* Swap out the page by writeback contents to the file. */
@@ -69,13 +66,17 @@ static bool file_backed_swap_out(struct page* page)
 {
     struct file_page* file_page UNUSED = &page->file;
     struct thread* owner = page->accessible_thread;
-    if (pml4_is_dirty(owner->pml4, page->va)) {
-        lock_acquire(&filesys_lock);
-        file_write_at(file_page->file, page->frame->kva, file_page->length, file_page->offset);
-        lock_release(&filesys_lock);
-        pml4_set_dirty(owner->pml4, page->va, false);
-    }
+    enum intr_level old_level;
+    bool dirty;
+
+    /* 쓰는 동안 소유자가 페이지를 바꾸지 못하도록 매핑을 먼저 해제.
+     * dirty 비트를 읽고 매핑을 지우는 사이에 소유자가 끼어들지 못하게 함 */
+    old_level = intr_disable();
+    dirty = pml4_is_dirty(owner->pml4, page->va);
     pml4_clear_page(owner->pml4, page->va);
+    intr_set_level(old_level);
+    if (dirty)
+        file_write_at(file_page->file, page->frame->kva, file_page->length, file_page->offset);
     page->frame = NULL;
     return true;
 }
@@ -84,18 +85,22 @@ static bool file_backed_swap_out(struct page* page)
 static void file_backed_destroy(struct page* page)
 {
     struct file_page* file_page UNUSED = &page->file;
+
+    vm_wait_eviction(page);
+#ifdef EFILESYS
+    /* 프레임은 page cache와 공유 중: 쓰기는 캐시에 넘기고 매핑만 해제 */
+    if (page->frame != NULL)
+        page_cache_unmap(page);
+    return;
+#endif
     if (page->frame != NULL) {
         struct thread* owner = page->accessible_thread;
         if (pml4_is_dirty(owner->pml4, page->va)) {
-            lock_acquire(&filesys_lock);
             file_write_at(file_page->file, page->frame->kva, file_page->length, file_page->offset);
-            lock_release(&filesys_lock);
             pml4_set_dirty(owner->pml4, page->va, false);
         }
         pml4_clear_page(owner->pml4, page->va);
-        page->frame->page = NULL;
-        vm_free_frame(page->frame);
-        page->frame = NULL;
+        vm_release_frame(page);
     }
     return;
 }
@@ -0,0 +1,286 @@
+/* text.c: Read-only executable text shared between processes.
+ *
+ * Every process running the same executable would otherwise read a
+ * private copy of each of its code pages. Instead, the pages of
+ * read-only segments are cached by (inode, offset, length) in holders:
+ * pages that belong to no thread, like the page cache of project 4.
+ * A process's text page maps its holder's frame, of which the holder is
+ * itself one of the sharers. When the clock picks such a frame,
+ * vm_evict_frame() unmaps it from every process and the holder drops
+ * it; text is never dirty, so nothing is written. */
+
+#include "vm/vm.h"
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+
+/* Text pages around a faulting one that are mapped along with it: the
+ * aligned 64 kB window that contains it. */
+#define TEXT_WINDOW 16
+
+static bool text_swap_in(struct page* page, void* kva);
+static bool text_swap_out(struct page* page);
+static void text_destroy(struct page* page);
+
+static const struct page_operations text_ops = {
+    .swap_in = text_swap_in,
+    .swap_out = text_swap_out,
+    .destroy = text_destroy,
+    .type = VM_TEXT,
+};
+
+/* Holders, keyed by (inode, offset, read_bytes). Holders are created,
+ * filled and dropped only with text_cache_lock held; eviction runs
+ * without it and is kept out by pinning the frame. */
+static struct hash text_cache;
+static struct lock text_cache_lock;
+
+/* Statistics. */
+static size_t holder_cnt;             /* Holders in the cache. */
+static unsigned long long hit_cnt;    /* Lookups that found a holder. */
+static unsigned long long miss_cnt;   /* Lookups that created one. */
+
+static uint64_t text_hash(const struct hash_elem* e, void* aux);
+static bool text_less(const struct hash_elem* a, const struct hash_elem* b, void* aux);
+static struct page* text_get_holder(struct page* page);
+static void text_put_holder(struct page* holder);
+static bool text_share(struct page* holder, struct page* page, bool may_evict);
+static void text_fault_around(struct page* page);
+
+void vm_text_init(void)
+{
+    hash_init(&text_cache, text_hash, text_less, NULL);
+    lock_init(&text_cache_lock);
+    lock_register(&text_cache_lock, "text cache");
+}
+
+/* Turn PAGE, an uninit page whose aux is its lazy_segment, into a
+ * process text page. The segment reference moves to the text page. */
+bool text_initializer(struct page* page, enum vm_type type UNUSED, void* kva UNUSED)
+{
+    struct lazy_segment* seg = page->uninit.aux;
+
+    page->operations = &text_ops;
+    page->text = (struct text_page){.seg = seg};
+    return true;
+}
+
+/* Faults in PAGE, a process text page, by mapping the frame of the
+ * cached copy, reading it from the executable only if no other process
+ * has. Untouched text pages nearby are mapped as well, as long as that
+ * takes no eviction. */
+bool text_map(struct page* page)
+{
+    struct page* holder;
+    bool success = false;
+
+    if (VM_TYPE(page->operations->type) == VM_UNINIT &&
+        !page->uninit.page_initializer(page, page->uninit.type, NULL))
+        return false;
+
+    lock_acquire(&text_cache_lock);
+    holder = text_get_holder(page);
+    if (holder != NULL)
+        success = text_share(holder, page, true);
+    if (success)
+        text_fault_around(page);
+    lock_release(&text_cache_lock);
+    return success;
+}
+
+/* Prints text cache statistics. */
+void text_print_stats(void)
+{
+    printf("Text cache: %zu pages, %llu hits, %llu misses\n", holder_cnt, hit_cnt, miss_cnt);
+}
+
+/* Returns PAGE's holder, looking it up or creating it the first time.
+ * Returns a null pointer if memory is not available. */
+static struct page* text_get_holder(struct page* page)
+{
+    struct lazy_segment* seg = page->text.seg;
+    struct page* holder;
+    struct page key;
+    struct hash_elem* e;
+
+    ASSERT(lock_held_by_current_thread(&text_cache_lock));
+
+    if (page->text.holder != NULL)
+        return page->text.holder;
+
+    key.text.file = seg->file;
+    key.text.offset = seg->ofs + ((uint8_t*)page->va - seg->upage);
+    key.text.read_bytes = lazy_segment_read_bytes(seg, page->va);
+    e = hash_find(&text_cache, &key.text.elem);
+    if (e != NULL) {
+        holder = hash_entry(e, struct page, text.elem);
+        hit_cnt++;
+    } else {
+        holder = kmem_cache_alloc(page_slab);
+        if (holder == NULL)
+            return NULL;
+        *holder = (struct page){.va = NULL, .frame = NULL, .writable = false, .accessible_thread = NULL};
+        holder->operations = &text_ops;
+        holder->text = key.text;
+        holder->text.file = file_reopen(seg->file);
+        if (holder->text.file == NULL) {
+            kmem_cache_free(page_slab, holder);
+            return NULL;
+        }
+        hash_insert(&text_cache, &holder->text.elem);
+        holder_cnt++;
+        miss_cnt++;
+    }
+    holder->text.users++;
+    page->text.holder = holder;
+    return holder;
+}
+
+/* Drops a user of HOLDER, removing it from the cache with the last
+ * one. */
+static void text_put_holder(struct page* holder)
+{
+    ASSERT(lock_held_by_current_thread(&text_cache_lock));
+
+    if (--holder->text.users > 0)
+        return;
+
+    /* 쫓겨나는 중이면 끝날 때까지 기다림: evictor는 text_cache_lock을 잡지 않음 */
+    while (holder->frame != NULL && !vm_pin_page(holder))
+        vm_wait_page(holder);
+    if (holder->frame != NULL)
+        vm_release_frame(holder);
+    hash_delete(&text_cache, &holder->text.elem);
+    holder_cnt--;
+    file_close(holder->text.file);
+    kmem_cache_free(page_slab, holder);
+}
+
+/* Maps HOLDER's frame into PAGE's address space, first bringing HOLDER
+ * in if it is not resident. Only a free frame is used for that unless
+ * MAY_EVICT. */
+static bool text_share(struct page* holder, struct page* page, bool may_evict)
+{
+    struct frame* frame;
+
+    ASSERT(lock_held_by_current_thread(&text_cache_lock));
+
+    while (!vm_share_frame(holder, page)) {
+        if (holder->frame != NULL) {
+            /* 쫓겨나는 중이면 기다림. 고정되지 않았는데 실패했으면 매핑할 메모리가 없음 */
+            if (!vm_wait_page(holder))
+                return false;
+        } else if (may_evict) {
+            if (!vm_claim_kernel_page(holder))
+                return false;
+        } else {
+            frame = vm_get_free_frame();
+            if (frame == NULL)
+                return false;
+            if (!text_swap_in(holder, frame->kva)) {
+                vm_free_frame(frame);
+                return false;
+            }
+            vm_map_prefetched(holder, frame);
+        }
+    }
+    holder->text.accessed = true;
+    return true;
+}
+
+/* Maps the text pages of PAGE's segment in the aligned window around
+ * PAGE that are not mapped yet. */
+static void text_fault_around(struct page* page)
+{
+    struct thread* owner = page->accessible_thread;
+    struct lazy_segment* seg = page->text.seg;
+    uint8_t* start = (uint8_t*)((uint64_t)page->va & ~((uint64_t)TEXT_WINDOW * PGSIZE - 1));
+    uint8_t* upage;
+
+    for (upage = start; upage < start + TEXT_WINDOW * PGSIZE; upage += PGSIZE) {
+        struct page* p;
+        struct page* holder;
+
+        if (upage == page->va)
+            continue;
+        p = spt_find_page(&owner->spt, upage);
+        if (p == NULL || p->frame != NULL || page_get_type(p) != VM_TEXT)
+            continue;
+        if (VM_TYPE(p->operations->type) == VM_UNINIT) {
+            if (p->uninit.aux != seg || !p->uninit.page_initializer(p, p->uninit.type, NULL))
+                continue;
+        } else if (p->text.seg != seg)
+            continue;
+
+        holder = text_get_holder(p);
+        if (holder == NULL || !text_share(holder, p, false))
+            return;
+    }
+}
+
+/* Reads HOLDER's page of the executable into KVA. Process text pages
+ * are always brought in through text_map() instead. */
+static bool text_swap_in(struct page* page, void* kva)
+{
+    struct text_page* text = &page->text;
+
+    ASSERT(page->accessible_thread == NULL);
+
+    if (file_read_at(text->file, kva, text->read_bytes, text->offset) != (int)text->read_bytes)
+        return false;
+    memset((uint8_t*)kva + text->read_bytes, 0, PGSIZE - text->read_bytes);
+    text->accessed = true;
+    return true;
+}
+
+/* Drops HOLDER's frame. vm_evict_frame() has already unmapped it from
+ * every process. */
+static bool text_swap_out(struct page* page)
+{
+    ASSERT(page->accessible_thread == NULL);
+    page->frame = NULL;
+    return true;
+}
+
+/* Destroys PAGE, a process text page. Holders are freed by
+ * text_put_holder() only. */
+static void text_destroy(struct page* page)
+{
+    struct text_page* text = &page->text;
+
+    ASSERT(page->accessible_thread != NULL);
+
+    lock_acquire(&text_cache_lock);
+    vm_release_frame(page);
+    if (text->holder != NULL)
+        text_put_holder(text->holder);
+    lock_release(&text_cache_lock);
+    lazy_segment_put(text->seg);
+}
+
+static uint64_t text_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+    const struct text_page* text = &hash_entry(e, struct page, text.elem)->text;
+    struct inode* inode = file_get_inode(text->file);
+
+    return hash_bytes(&inode, sizeof inode) ^ hash_int(text->offset) ^ hash_int(text->read_bytes);
+}
+
+static bool text_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED)
+{
+    const struct text_page* a = &hash_entry(a_, struct page, text.elem)->text;
+    const struct text_page* b = &hash_entry(b_, struct page, text.elem)->text;
+    struct inode* a_inode = file_get_inode(a->file);
+    struct inode* b_inode = file_get_inode(b->file);
+
+    if (a_inode != b_inode)
+        return a_inode < b_inode;
+    if (a->offset != b->offset)
+        return a->offset < b->offset;
+    return a->read_bytes < b->read_bytes;
+}
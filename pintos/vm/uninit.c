@@ -10,6 +10,7 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include "userprog/process.h"
 
 static bool uninit_initialize(struct page* page, void* kva);
 static void uninit_destroy(struct page* page);
@@ -62,7 +63,11 @@ static void uninit_destroy(struct page* page)
     /* TODO: Fill this function.
      * TODO: If you don't have anything to do, just return. */
     if (uninit->aux != NULL) { // close file in do_munmap
-        free(uninit->aux);
+        /* 익명·text 페이지의 aux는 여러 페이지가 공유하는 lazy_segment */
+        if (VM_TYPE(uninit->type) == VM_ANON || VM_TYPE(uninit->type) == VM_TEXT)
+            lazy_segment_put(uninit->aux);
+        else
+            free(uninit->aux);
         uninit->aux = NULL;
     }
 }
@@ -2,9 +2,12 @@
 
 #include "hash.h"
 #include "list.h"
+#include "round.h"
 #include "string.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/mmu.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -14,9 +17,37 @@
 #include "vm/vm.h"
 #define STACK_MAX_SIZE (1 << 20)
 
-static struct list frame_table;
+/* Frame table: one entry per page of the user pool, indexed by the
+ * physical frame number relative to the pool base. */
+static struct frame* frame_table;
+static size_t frame_cnt;
+static uint8_t* user_pool_base;
+static struct list free_frames;   /* Free-frame stack, top at the front. */
+static size_t free_cnt;           /* Number of frames on the free-frame stack. */
+static size_t clock_hand;         /* Index of the next frame the clock inspects. */
 static struct lock frame_lock;
-static struct list_elem* next;
+static struct condition frame_cond; /* Broadcast when a frame is unpinned or evicted. */
+
+/* Exact-size slabs for `struct page', shared with the page cache. */
+struct kmem_cache* page_slab;
+
+/* Page-out daemon. It is woken when the free-frame stack drops below
+ * vm_wm_low frames and evicts until vm_wm_high frames are free, so that
+ * faults rarely have to swap out synchronously. 0 picks a default. */
+size_t vm_wm_low;
+size_t vm_wm_high;
+static struct semaphore pageout_sema;
+static bool pageout_wanted; /* Daemon was signalled and has not caught up yet. */
+
+static void pageout_daemon(void* aux);
+static void push_free_frame(struct frame* frame);
+static void unpin_frame(struct frame* frame);
+static struct frame* vm_evict_frame(void);
+static struct frame* kva_to_frame(void* kva);
+static struct frame* vm_get_huge_run(void);
+static void vm_free_huge_run(struct frame* run);
+static void inspect_huge(struct intr_frame* f);
+static void inspect_frames(struct intr_frame* f);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -24,14 +55,81 @@ void vm_init(void)
 {
     vm_anon_init();
     vm_file_init();
+    vm_text_init();
 #ifdef EFILESYS /* For project 4 */
     pagecache_init();
 #endif
     register_inspect_intr();
     /* DO NOT MODIFY UPPER LINES. */
     /* TODO: Your code goes here. */
-    list_init(&frame_table);
+    void* base;
+    page_slab = kmem_cache_create("page", sizeof(struct page), 0, NULL);
+    if (page_slab == NULL)
+        PANIC("vm_init: out of memory");
+    palloc_user_pool_range(&base, &frame_cnt);
+    user_pool_base = base;
+    frame_table = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, DIV_ROUND_UP(frame_cnt * sizeof(struct frame), PGSIZE));
+    for (size_t i = 0; i < frame_cnt; i++) {
+        frame_table[i].kva = user_pool_base + i * PGSIZE;
+        list_init(&frame_table[i].sharers);
+    }
+    list_init(&free_frames);
+    free_cnt = 0;
+    clock_hand = 0;
     lock_init(&frame_lock);
+    lock_register(&frame_lock, "frame");
+    cond_init(&frame_cond);
+
+    /* 유저 풀 전체를 frame table이 소유: 이후 프레임은 free-frame stack에서만 얻음 */
+    void* kva;
+    while ((kva = palloc_get_page(PAL_USER)) != NULL)
+        push_free_frame(kva_to_frame(kva));
+
+    if (vm_wm_low == 0)
+        vm_wm_low = free_cnt / 64 > 4 ? free_cnt / 64 : 4;
+    if (vm_wm_high <= vm_wm_low)
+        vm_wm_high = vm_wm_low * 2;
+    sema_init(&pageout_sema, 0);
+    pageout_wanted = false;
+    thread_create("pageoutd", PRI_DEFAULT, pageout_daemon, NULL);
+    intr_register_int(0x45, 3, INTR_OFF, inspect_huge, "Inspect 2 MB Page");
+    intr_register_int(0x46, 3, INTR_OFF, inspect_frames, "Inspect Frame Count");
+}
+
+/* Push FRAME onto the free-frame stack. Must be called with frame_lock
+ * held, except during vm_init(). */
+static void push_free_frame(struct frame* frame)
+{
+    list_push_front(&free_frames, &frame->free_elem);
+    frame->free = true;
+    free_cnt++;
+}
+
+/* Unpin FRAME and wake the threads waiting for it in vm_wait_page() or
+ * vm_wait_frame(). Must be called with frame_lock held. */
+static void unpin_frame(struct frame* frame)
+{
+    frame->pinned = false;
+    cond_broadcast(&frame_cond, &frame_lock);
+}
+
+/* Page-out daemon: reclaim frames in the background between the low and
+ * high watermarks. Dirty file-backed victims are written back and
+ * anonymous victims go to swap through the regular swap_out path. */
+static void pageout_daemon(void* aux UNUSED)
+{
+    for (;;) {
+        sema_down(&pageout_sema);
+        while (free_cnt < vm_wm_high) {
+            struct frame* frame = vm_evict_frame();
+            if (frame == NULL)
+                break;
+            vm_free_frame(frame);
+        }
+        lock_acquire(&frame_lock);
+        pageout_wanted = false;
+        lock_release(&frame_lock);
+    }
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -50,11 +148,21 @@ enum vm_type page_get_type(struct page* page)
 
 /* Helpers */
 static bool vm_do_claim_page(struct page* page);
-static struct frame* vm_evict_frame(void);
-static bool rollback_claim(struct thread* current, struct frame* frame, struct page* page, bool mapping_set);
+static bool rollback_claim(struct thread* owner, struct page* page, bool mapping_set);
+static bool vm_share_page(struct page* src, struct page* dst);
+static void spt_detach_page(struct hash_elem* hash_elem, void* dead);
 static struct frame* vm_get_victim(void);
-static struct frame* clock(struct list_elem* start);
-static struct list_elem* get_next(struct list_elem* elem);
+static struct frame* clock(void);
+static void link_frame(struct frame* frame, struct page* page);
+static bool frame_is_huge(struct frame* f);
+static bool page_test_accessed(struct page* p);
+static bool frame_test_accessed(struct frame* f);
+static bool frame_is_dirty(struct frame* f);
+static struct page* frame_unmap_all(struct frame* f);
+static struct frame* vm_evict_shared(struct frame* victim);
+static bool page_is_dirty(struct page* p);
+static bool vm_try_map_huge(struct page* page);
+static void vm_try_collapse_huge(struct page* page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -71,7 +179,7 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void* upage, bool writabl
          * TODO: and then create "uninit" page struct by calling uninit_new. You
          * TODO: should modify the field after calling the uninit_new. */
         /* TODO: Insert the page into the spt. */
-        struct page* p = (struct page*)malloc(sizeof(struct page));
+        struct page* p = kmem_cache_alloc(page_slab);
         if (p == NULL)
             return false;
         bool (*page_initializer)(struct page*, enum vm_type, void*);
@@ -83,12 +191,15 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void* upage, bool writabl
         case VM_FILE:
             page_initializer = file_backed_initializer;
             break;
+        case VM_TEXT:
+            page_initializer = text_initializer;
+            break;
         }
         uninit_new(p, upage, init, type, aux, page_initializer);
         p->writable = writable;
         p->accessible_thread = thread_current();
         if (!spt_insert_page(spt, p)) {
-            free(p);
+            kmem_cache_free(page_slab, p);
             return false;
         }
         return true;
@@ -103,7 +214,9 @@ struct page* spt_find_page(struct supplemental_page_table* spt, void* va)
     struct hash_elem* hash_e;
     struct page tmp_page;
     tmp_page.va = pg_round_down(va);
+    rwlock_acquire_read(&spt->lock);
     hash_e = hash_find(&spt->hash_table, &tmp_page.hash_elem);
+    rwlock_release_read(&spt->lock);
     if (hash_e == NULL)
         return NULL;
     else
@@ -114,47 +227,51 @@ struct page* spt_find_page(struct supplemental_page_table* spt, void* va)
 bool spt_insert_page(struct supplemental_page_table* spt, struct page* page)
 {
     /* TODO: Fill this function. */
-    if (hash_insert(&spt->hash_table, &page->hash_elem) == NULL)
-        return true;
-    return false;
+    struct hash_elem* old;
+
+    rwlock_acquire_write(&spt->lock);
+    old = hash_insert(&spt->hash_table, &page->hash_elem);
+    rwlock_release_write(&spt->lock);
+    return old == NULL;
 }
 
 void spt_remove_page(struct supplemental_page_table* spt, struct page* page)
 {
+    rwlock_acquire_write(&spt->lock);
     hash_delete(&spt->hash_table, &page->hash_elem);
+    rwlock_release_write(&spt->lock);
     vm_dealloc_page(page);
     return;
 }
 
-static struct list_elem* get_next(struct list_elem* elem)
+/* Map a user pool kva to its frame table entry. */
+static struct frame* kva_to_frame(void* kva)
 {
-    struct list_elem* next_elem = list_next(elem);
-    if (next_elem == list_end(&frame_table))
-        next_elem = list_begin(&frame_table);
-    return next_elem;
+    size_t idx = pg_no(kva) - pg_no(user_pool_base);
+    ASSERT(idx < frame_cnt);
+    return &frame_table[idx];
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted.
+ * Must be called with frame_lock held. The victim is returned pinned so
+ * that no one else picks it while it is swapped out. */
 static struct frame* vm_get_victim(void)
 {
-    ASSERT(!list_empty(&frame_table));
-    if (next == NULL || next == list_end(&frame_table))
-        next = list_begin(&frame_table);
-
-    struct list_elem* start = next;
-    return clock(start);
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+    struct frame* victim = clock();
+    if (victim != NULL)
+        victim->pinned = true;
+    return victim;
 }
 
-static struct frame* clock(struct list_elem* start)
+static struct frame* clock(void)
 {
-    ASSERT(!list_empty(&frame_table));
-    struct frame* victim = NULL;
     /*
         eviction 우선순위
-          1) 비어있는 프레임
-          2) 접근 비트 0인 페이지
+          1) 접근 비트 0인 페이지
              - dirty 0 우선, 그래도 없으면 dirty 1
-          3) 접근 비트 1이면 접근 비트를 0으로 내리고 다음으로 이동
+          2) 접근 비트 1이면 접근 비트를 0으로 내리고 다음으로 이동
+        비어있거나(page == NULL) pinned 된 프레임은 건너뜀
 
         trial 의미
           - 첫 바퀴(trial=0)에서 못 찾는 경우:
@@ -162,62 +279,265 @@ static struct frame* clock(struct list_elem* start)
               * accessed=0이더라도 모두 dirty=1인 경우
           - 두 번째 바퀴(trial=1)에서는 accessed=0인 페이지를 dirty 여부와 상관없이 처음 만나는 대로 선택
 
-        → second chance 개념을 clock으로 구현
+        → second chance 개념을 clock으로 구현, clock_hand는 frame_table의 index
     */
-    for (int trial = 0; trial < 2 && victim == NULL; trial++) {
-        do {
-            struct frame* f = list_entry(next, struct frame, frame_elem);
+    for (int trial = 0; trial < 2; trial++) {
+        for (size_t n = 0; n < frame_cnt; n++) {
+            struct frame* f = &frame_table[clock_hand];
             struct page* p = f->page;
+            clock_hand = (clock_hand + 1) % frame_cnt;
 
-            if (p == NULL) {
-                victim = f;
-                break;
-            }
+            /* 여러 주소 공간에 매핑된 프레임도 후보: 비트는 모든 매핑에서 모아 봄 */
+            if (p == NULL || f->pinned)
+                continue;
 
-            bool accessed = pml4_is_accessed(p->accessible_thread->pml4, p->va);
-            if (accessed) {
-                pml4_set_accessed(p->accessible_thread->pml4, p->va, false);
-            } else {
-                if (trial == 0) {
-                    if (!pml4_is_dirty(p->accessible_thread->pml4, p->va)) {
-                        victim = f;
-                        break;
-                    }
-                } else {
-                    victim = f;
-                    break;
+            if (frame_is_huge(f)) {
+                /* 2 MB 페이지의 접근 비트는 PDE 하나뿐: run마다 한 번만 검사하고 지움 */
+                if (frame_test_accessed(f)) {
+                    size_t rest = HUGE_PGCNT - 1 - pg_no(vtop(f->kva)) % HUGE_PGCNT;
+                    clock_hand = (clock_hand + rest) % frame_cnt;
+                    n += rest;
+                    continue;
                 }
-            }
-
-            next = get_next(next);
-        } while (next != start);
-
-        if (victim == NULL) {
-            next = get_next(start);
-            start = next;
+            } else if (frame_test_accessed(f))
+                continue;
+            if (trial == 0 && frame_is_dirty(f))
+                continue;
+            return f;
         }
     }
+    return NULL;
+}
 
-    if (victim != NULL) {
-        next = get_next(&victim->frame_elem);
+/* Returns true if F is one of the frames of a 2 MB page, which all
+ * share the accessed and dirty bits of its page directory entry. Must
+ * be called with frame_lock held. */
+static bool frame_is_huge(struct frame* f)
+{
+    struct page* p = f->page;
+
+    return p->accessible_thread != NULL && VM_TYPE(p->operations->type) == VM_ANON && p->anon.huge &&
+           pml4_is_huge(p->accessible_thread->pml4, p->va);
+}
+
+/* Test and clear the accessed bit of P. Kernel-owned pages, such as the
+ * page cache, live in no address space and keep a bit of their own. */
+static bool page_test_accessed(struct page* p)
+{
+    if (p->accessible_thread == NULL && VM_TYPE(p->operations->type) == VM_TEXT) {
+        bool accessed = p->text.accessed;
+        p->text.accessed = false;
+        return accessed;
     }
-    return victim;
+#ifdef EFILESYS
+    if (p->accessible_thread == NULL) {
+        bool accessed = p->page_cache.accessed;
+        p->page_cache.accessed = false;
+        return accessed;
+    }
+#endif
+    uint64_t* pml4 = p->accessible_thread->pml4;
+    if (!pml4_is_accessed(pml4, p->va))
+        return false;
+    pml4_set_accessed(pml4, p->va, false);
+    return true;
+}
+
+/* Test and clear the accessed bits of every page mapping F. Must be
+ * called with frame_lock held. */
+static bool frame_test_accessed(struct frame* f)
+{
+    struct list_elem* e;
+    bool accessed = false;
+
+    /* 모든 공유자의 비트를 지워야 하므로 중간에 멈추지 않음 */
+    for (e = list_begin(&f->sharers); e != list_end(&f->sharers); e = list_next(e))
+        if (page_test_accessed(list_entry(e, struct page, share_elem)))
+            accessed = true;
+    return accessed;
+}
+
+/* Returns true if any page mapping F must be written back before F is
+ * reused. Must be called with frame_lock held. */
+static bool frame_is_dirty(struct frame* f)
+{
+    struct list_elem* e;
+
+    for (e = list_begin(&f->sharers); e != list_end(&f->sharers); e = list_next(e))
+        if (page_is_dirty(list_entry(e, struct page, share_elem)))
+            return true;
+    return false;
+}
+
+/* Returns true if P must be written back before its frame is reused. */
+static bool page_is_dirty(struct page* p)
+{
+    if (VM_TYPE(p->operations->type) == VM_TEXT)
+        return false;
+#ifdef EFILESYS
+    if (p->accessible_thread == NULL)
+        return p->page_cache.dirty;
+#endif
+    return pml4_is_dirty(p->accessible_thread->pml4, p->va);
 }
 
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame* vm_evict_frame(void)
 {
+    struct page* page = NULL;
+
+    lock_acquire(&frame_lock);
     struct frame* victim = vm_get_victim();
+    /* 매핑이 여럿이면 swap_out 전에 rmap을 따라 모든 PTE를 지움.
+     * 매핑이 하나뿐이면 swap_out이 dirty 비트를 읽은 뒤 직접 지움 */
+    if (victim != NULL && victim->ref_cnt > 1 && frame_unmap_all(victim) == NULL) {
+        /* 쓰는 동안 공유자가 모두 exit 해도 프레임이 free-frame stack으로 가지 않도록 */
+        victim->ref_cnt++;
+        lock_release(&frame_lock);
+        return vm_evict_shared(victim);
+    }
+    if (victim != NULL) {
+        /* swap_out 전에 연결을 끊어 둠. 그동안 소유자가 exit 하면 destroy는
+         * vm_wait_eviction()에서 swap_out이 끝나기를 기다림 */
+        page = victim->page;
+        list_remove(&page->share_elem);
+        victim->ref_cnt = 0;
+        victim->page = NULL;
+        victim->evicting = true;
+    }
+    lock_release(&frame_lock);
     /* TODO: swap out the victim and return the evicted frame. */
 
-    if (victim == NULL || !swap_out(victim->page))
+    /* swap_out은 frame_lock 밖에서 수행: file-backed page는 inode lock을 잡는데,
+     * 파일 시스템 안에서 page fault가 나면 frame_lock을 기다릴 수 있음 */
+    if (victim == NULL)
         return NULL;
+    if (!swap_out(page)) {
+        lock_acquire(&frame_lock);
+        link_frame(victim, page);
+        victim->evicting = false;
+        unpin_frame(victim);
+        lock_release(&frame_lock);
+        return NULL;
+    }
+    /* 이후 page는 해제될 수 있으므로 건드리지 않음 */
+    lock_acquire(&frame_lock);
+    victim->evicting = false;
+    cond_broadcast(&frame_cond, &frame_lock);
+    lock_release(&frame_lock);
+    return victim;
+}
+
+/* Clear every mapping of F, which is being evicted, by walking its
+ * sharers, the frame's reverse map. A dirty bit is handed to the page
+ * that will be written back.
+ *
+ * If F belongs to a holder (a text or page cache page), the processes'
+ * pages are detached and fault back in through the holder later; the
+ * holder is returned and becomes F's page. Otherwise the pages, which
+ * share F copy-on-write, stay attached until vm_evict_shared() has
+ * written F to swap, and faults on them wait; a null pointer is
+ * returned. Must be called with frame_lock held. */
+static struct page* frame_unmap_all(struct frame* f)
+{
+    struct page* holder = NULL;
+    struct list_elem* e;
+
+    for (e = list_begin(&f->sharers); e != list_end(&f->sharers); e = list_next(e)) {
+        struct page* p = list_entry(e, struct page, share_elem);
+        if (p->accessible_thread == NULL)
+            holder = p;
+    }
 
+    e = list_begin(&f->sharers);
+    while (e != list_end(&f->sharers)) {
+        struct page* p = list_entry(e, struct page, share_elem);
+        uint64_t* pml4 = p->accessible_thread != NULL ? p->accessible_thread->pml4 : NULL;
+        e = list_next(e);
+        if (pml4 == NULL)
+            continue;
+#ifdef EFILESYS
+        if (holder != NULL && VM_TYPE(holder->operations->type) == VM_PAGE_CACHE && pml4_is_dirty(pml4, p->va))
+            holder->page_cache.dirty = true;
+#endif
+        pml4_clear_page(pml4, p->va);
+        if (holder != NULL) {
+            list_remove(&p->share_elem);
+            p->frame = NULL;
+            f->ref_cnt--;
+        }
+    }
+    if (holder != NULL) {
+        ASSERT(f->ref_cnt == 1);
+        f->page = holder;
+    }
+    return holder;
+}
+
+/* Evict VICTIM, an anonymous frame shared copy-on-write, whose
+ * mappings frame_unmap_all() has cleared and on which the caller holds
+ * an extra reference. Its contents go to one swap slot, which every
+ * page still sharing it takes a reference to once the write is done.
+ * Returns VICTIM, pinned. */
+static struct frame* vm_evict_shared(struct frame* victim)
+{
+    size_t slot_idx = anon_swap_out_shared(victim->kva);
+
+    lock_acquire(&frame_lock);
+    while (!list_empty(&victim->sharers)) {
+        struct page* p = list_entry(list_pop_front(&victim->sharers), struct page, share_elem);
+        ASSERT(VM_TYPE(p->operations->type) == VM_ANON);
+        anon_share_slot(p, slot_idx);
+        p->frame = NULL;
+    }
+    victim->ref_cnt = 0;
     victim->page = NULL;
+    cond_broadcast(&frame_cond, &frame_lock);
+    lock_release(&frame_lock);
+    anon_put_slot(slot_idx);
     return victim;
 }
 
+/* Pin PAGE's frame so that it can be swapped out together with another
+ * victim. Succeeds only for a resident, unshared, unpinned page that has
+ * not been accessed since the clock hand last passed it. */
+bool vm_isolate_page(struct page* page)
+{
+    bool success = false;
+
+    lock_acquire(&frame_lock);
+    struct frame* f = page->frame;
+    if (f != NULL && !f->pinned && f->ref_cnt == 1 && !pml4_is_accessed(page->accessible_thread->pml4, page->va)) {
+        f->pinned = true;
+        success = true;
+    }
+    lock_release(&frame_lock);
+    return success;
+}
+
+/* Undo vm_isolate_page() for FRAME, which stays resident. */
+void vm_unpin_frame(struct frame* frame)
+{
+    lock_acquire(&frame_lock);
+    unpin_frame(frame);
+    lock_release(&frame_lock);
+}
+
+/* Return FRAME, isolated by vm_isolate_page() and whose page has just
+ * been written to swap, to the free-frame stack. */
+void vm_free_evicted_frame(struct frame* frame)
+{
+    lock_acquire(&frame_lock);
+    ASSERT(frame->pinned && frame->ref_cnt == 1);
+    list_remove(&frame->page->share_elem);
+    frame->ref_cnt = 0;
+    frame->page = NULL;
+    unpin_frame(frame);
+    push_free_frame(frame);
+    lock_release(&frame_lock);
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
@@ -226,22 +546,91 @@ static struct frame* vm_get_frame(void)
 {
     struct frame* frame = NULL;
     /* TODO: Fill this function. */
-    void* kva = palloc_get_page(PAL_USER);
-    if (kva == NULL) {
-        return vm_evict_frame();
+    frame = vm_get_free_frame();
+    if (frame == NULL)
+        frame = vm_evict_frame();
+    return frame;
+}
+
+/* Take a frame from the free-frame stack without evicting anything.
+ * Returns NULL if the stack is empty. The frame is returned pinned.
+ * Swap read-ahead uses this so that it never pushes other pages out.
+ * Wakes the page-out daemon when the stack runs low. */
+struct frame* vm_get_free_frame(void)
+{
+    struct frame* frame;
+    bool wake = false;
+
+    lock_acquire(&frame_lock);
+    frame = NULL;
+    if (!list_empty(&free_frames)) {
+        frame = list_entry(list_pop_front(&free_frames), struct frame, free_elem);
+        frame->free = false;
+        free_cnt--;
     }
-    frame = (struct frame*)malloc(sizeof(struct frame));
-    if (frame == NULL) {
-        palloc_free_page(kva);
-        return NULL;
+    if (free_cnt < vm_wm_low && !pageout_wanted) {
+        pageout_wanted = true;
+        wake = true;
     }
-    frame->kva = kva;
-    frame->page = NULL;
-    frame->in_table = false;
+    lock_release(&frame_lock);
+
+    if (wake)
+        sema_up(&pageout_sema);
+    if (frame == NULL)
+        return NULL;
+    frame->pinned = true;
     ASSERT(frame->page == NULL);
+    ASSERT(frame->ref_cnt == 0);
     return frame;
 }
 
+/* Take HUGE_PGCNT free frames that are physically contiguous and 2 MB
+ * aligned off the free-frame stack, without evicting anything. Returns
+ * the first of them, pinned, or NULL if there is no such run or taking
+ * one would leave fewer than vm_wm_high frames free. */
+static struct frame* vm_get_huge_run(void)
+{
+    struct frame* run = NULL;
+    size_t first, run_cnt, i;
+
+    /* 유저 풀의 시작은 2 MB 경계가 아닐 수 있음: 물리 주소 기준으로 정렬 */
+    first = (HUGE_PGCNT - pg_no(vtop(user_pool_base)) % HUGE_PGCNT) % HUGE_PGCNT;
+    run_cnt = first < frame_cnt ? (frame_cnt - first) / HUGE_PGCNT : 0;
+
+    lock_acquire(&frame_lock);
+    if (free_cnt >= vm_wm_high + HUGE_PGCNT) {
+        for (size_t n = 0; n < run_cnt && run == NULL; n++) {
+            struct frame* f = &frame_table[first + n * HUGE_PGCNT];
+            for (i = 0; i < HUGE_PGCNT && f[i].free; i++)
+                continue;
+            if (i == HUGE_PGCNT)
+                run = f;
+        }
+    }
+    if (run != NULL) {
+        for (i = 0; i < HUGE_PGCNT; i++) {
+            list_remove(&run[i].free_elem);
+            run[i].free = false;
+            run[i].pinned = true;
+        }
+        free_cnt -= HUGE_PGCNT;
+    }
+    lock_release(&frame_lock);
+    return run;
+}
+
+/* Return RUN, taken by vm_get_huge_run() and never linked to any
+ * page, to the free-frame stack. */
+static void vm_free_huge_run(struct frame* run)
+{
+    lock_acquire(&frame_lock);
+    for (size_t i = 0; i < HUGE_PGCNT; i++) {
+        unpin_frame(&run[i]);
+        push_free_frame(&run[i]);
+    }
+    lock_release(&frame_lock);
+}
+
 /* Growing the stack. */
 static void vm_stack_growth(void* addr)
 {
@@ -251,6 +640,61 @@ static void vm_stack_growth(void* addr)
 /* Handle the fault on write_protected page */
 static bool vm_handle_wp(struct page* page)
 {
+    uint64_t* pml4 = page->accessible_thread->pml4;
+    struct frame* old = page->frame;
+    struct frame* new;
+
+    if (!page->writable)
+        return false;
+    /* fault 이후 쫓겨났음: 다시 fault 하면 swap에서 읽어 옴 */
+    if (old == NULL)
+        return true;
+
+    lock_acquire(&frame_lock);
+    /* 쫓겨나는 중: 끝나기를 기다렸다가 다시 fault 하여 swap에서 읽어 옴 */
+    if (old->pinned) {
+        while (page->frame == old && old->pinned)
+            cond_wait(&frame_cond, &frame_lock);
+        lock_release(&frame_lock);
+        return true;
+    }
+    /* 마지막 공유자라면 복사 없이 쓰기 권한만 복구 */
+    if (old->ref_cnt == 1) {
+        pml4_set_writable(pml4, page->va, true);
+        lock_release(&frame_lock);
+        return true;
+    }
+    lock_release(&frame_lock);
+
+    new = vm_get_frame();
+    if (new == NULL)
+        return false;
+    memcpy(new->kva, old->kva, PGSIZE);
+
+    lock_acquire(&frame_lock);
+    if (page->frame != old || old->pinned) {
+        /* 복사 도중 old가 evict 되었음: 복사본을 버리고 fault를 다시 발생시킴 */
+        lock_release(&frame_lock);
+        vm_free_frame(new);
+        return true;
+    }
+    list_remove(&page->share_elem);
+    if (--old->ref_cnt == 0) {
+        old->page = NULL;
+        push_free_frame(old);
+    } else if (old->page == page)
+        old->page = list_entry(list_front(&old->sharers), struct page, share_elem);
+
+    new->page = page;
+    new->ref_cnt = 1;
+    list_push_back(&new->sharers, &page->share_elem);
+    page->frame = new;
+    lock_release(&frame_lock);
+
+    if (!pml4_set_page(pml4, page->va, new->kva, true))
+        return rollback_claim(page->accessible_thread, page, true);
+    vm_unpin_frame(new);
+    return true;
 }
 
 /* Return true on success */
@@ -277,7 +721,23 @@ bool vm_try_handle_fault(struct intr_frame* f, void* addr, bool user, bool write
             return false;
         if (write == 1 && page->writable == 0)
             return false;
-        return vm_do_claim_page(page);
+        /* 프레임이 쫓겨나는 중이라 매핑만 먼저 지워진 상태: 끝난 뒤 다시 fault */
+        if (page->frame != NULL) {
+            vm_wait_page(page);
+            return true;
+        }
+        if (vm_try_map_huge(page))
+            return true;
+        if (!vm_do_claim_page(page))
+            return false;
+        vm_try_collapse_huge(page);
+        return true;
+    }
+    /* present 페이지에 대한 쓰기 fault: copy-on-write 공유 페이지 분리 */
+    if (write) {
+        page = spt_find_page(spt, addr);
+        if (page != NULL)
+            return vm_handle_wp(page);
     }
     return false;
 }
@@ -287,7 +747,7 @@ bool vm_try_handle_fault(struct intr_frame* f, void* addr, bool user, bool write
 void vm_dealloc_page(struct page* page)
 {
     destroy(page);
-    free(page);
+    kmem_cache_free(page_slab, page);
 }
 
 /* Claim the page that allocate on VA. */
@@ -301,34 +761,342 @@ bool vm_claim_page(void* va)
     return vm_do_claim_page(page);
 }
 
+/* Returns true if PAGE is an anonymous page that has not been touched
+ * yet and starts out zero-filled: a stack page or a page of a
+ * segment's BSS. */
+static bool page_is_fresh_zero(struct page* page)
+{
+    /* 파일 내용이 있는 segment 페이지만 init이 있음 */
+    return VM_TYPE(page->operations->type) == VM_UNINIT && VM_TYPE(page->uninit.type) == VM_ANON &&
+           page->uninit.init == NULL;
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool vm_do_claim_page(struct page* page)
 {
+    /* 실행 파일 text는 다른 프로세스와 같은 프레임을 매핑 */
+    if (page->accessible_thread != NULL && page_get_type(page) == VM_TEXT)
+        return text_map(page);
+#ifdef EFILESYS
+    /* mmap 페이지는 개인 사본 대신 page cache의 프레임을 그대로 매핑 */
+    if (page->accessible_thread != NULL && page_get_type(page) == VM_FILE)
+        return page_cache_map(page);
+#endif
     struct frame* frame = vm_get_frame();
     if (frame == NULL)
         return false;
-    if (!frame->in_table) {
-        lock_acquire(&frame_lock);
-        list_push_back(&frame_table, &frame->frame_elem);
-        lock_release(&frame_lock);
-        frame->in_table = true;
-    }
 
     /* Set links */
-    frame->page = page;
-    page->frame = frame;
+    link_frame(frame, page);
 
     /* TODO: Insert page table entry to map page's VA to frame's PA. */
-    struct thread* current = thread_current();
-    if (!pml4_set_page(current->pml4, page->va, frame->kva, page->writable))
-        return rollback_claim(current, frame, page, false);
+    /* fork 중에는 부모의 페이지를 claim 하므로 thread_current()가 아닌 소유자의 pml4 사용 */
+    /* 소유자가 없는 커널 페이지(page cache)는 매핑하지 않음 */
+    struct thread* owner = page->accessible_thread;
+    if (owner != NULL && !pml4_set_page(owner->pml4, page->va, frame->kva, page->writable))
+        return rollback_claim(owner, page, false);
 
+    /* free-frame stack의 프레임에는 이전 내용이 남아 있음 */
+    if (page_is_fresh_zero(page))
+        memset(frame->kva, 0, PGSIZE);
     if (!swap_in(page, frame->kva))
-        return rollback_claim(current, frame, page, true);
+        return rollback_claim(owner, page, owner != NULL);
+
+    vm_unpin_frame(frame);
+    return true;
+}
+
+
+/* Returns true if P is fresh, as the faulting page LIKE is, and has
+ * LIKE's permissions. */
+static bool page_is_fresh_like(struct page* p, struct page* like)
+{
+    return p != NULL && page_is_fresh_zero(p) && p->writable == like->writable;
+}
+
+/* Back the 2 MB aligned region around PAGE, which has just faulted,
+ * by a single 2 MB page. This works only if every page of the region
+ * is fresh and zero-filled, with PAGE's permissions, and a 2 MB run of
+ * frames is free; otherwise nothing is changed and false is returned.
+ * Eviction, copy-on-write and exit later split the 2 MB page back into
+ * 4 kB pages through the pml4 functions. */
+static bool vm_try_map_huge(struct page* page)
+{
+    struct thread* cur = thread_current();
+    uint8_t* base = (uint8_t*)((uint64_t)page->va & ~HUGE_PGMASK);
+    struct page** pages;
+    struct frame* run;
+    bool success = false;
+    size_t i;
+
+    if (page->accessible_thread != cur || !page_is_fresh_zero(page))
+        return false;
+
+    /* 전체를 훑기 전에 양 끝과 이웃부터: 대부분의 실패는 여기서 걸러짐 */
+    if (!page_is_fresh_like(spt_find_page(&cur->spt, base), page) ||
+        !page_is_fresh_like(spt_find_page(&cur->spt, base + HUGE_PGSIZE - PGSIZE), page))
+        return false;
+    if ((uint8_t*)page->va != base && !page_is_fresh_like(spt_find_page(&cur->spt, page->va - PGSIZE), page))
+        return false;
+
+    /* 포인터 512개는 커널 스택에 두기에 너무 큼 */
+    pages = palloc_get_page(0);
+    if (pages == NULL)
+        return false;
+    for (i = 0; i < HUGE_PGCNT; i++) {
+        pages[i] = spt_find_page(&cur->spt, base + i * PGSIZE);
+        if (!page_is_fresh_like(pages[i], page))
+            goto done;
+    }
+
+    run = vm_get_huge_run();
+    if (run == NULL)
+        goto done;
+    memset(run->kva, 0, HUGE_PGSIZE);
+    if (!pml4_set_huge_page(cur->pml4, base, run->kva, page->writable)) {
+        vm_free_huge_run(run);
+        goto done;
+    }
+
+    /* 내용은 이미 0, fresh 페이지에는 init도 aux도 없음 */
+    for (i = 0; i < HUGE_PGCNT; i++) {
+        struct page* p = pages[i];
+        p->uninit.page_initializer(p, p->uninit.type, run[i].kva);
+        p->anon.huge = true;
+    }
+    lock_acquire(&frame_lock);
+    for (i = 0; i < HUGE_PGCNT; i++) {
+        link_frame(&run[i], pages[i]);
+        unpin_frame(&run[i]);
+    }
+    lock_release(&frame_lock);
+    success = true;
+
+done:
+    palloc_free_page(pages);
+    return success;
+}
+
+/* Returns true if P is an anonymous page that was part of a 2 MB page,
+ * is resident, and has LIKE's permissions. */
+static bool page_is_resident_huge(struct page* p, struct page* like)
+{
+    return p != NULL && VM_TYPE(p->operations->type) == VM_ANON && p->anon.huge && p->frame != NULL &&
+           p->writable == like->writable;
+}
+
+/* PAGE, which was part of a 2 MB page, has just been brought back in.
+ * Once every page of its 2 MB region is resident again and none is
+ * shared, copy them into a 2 MB run of frames and map the region by a
+ * single 2 MB page again. */
+static void vm_try_collapse_huge(struct page* page)
+{
+    struct thread* cur = thread_current();
+    uint8_t* base = (uint8_t*)((uint64_t)page->va & ~HUGE_PGMASK);
+    struct page** pages;
+    struct frame* run;
+    size_t i, pinned;
+
+    if (page->accessible_thread != cur || VM_TYPE(page->operations->type) != VM_ANON || !page->anon.huge)
+        return;
+    if (!page_is_resident_huge(spt_find_page(&cur->spt, base), page) ||
+        !page_is_resident_huge(spt_find_page(&cur->spt, base + HUGE_PGSIZE - PGSIZE), page))
+        return;
+
+    pages = palloc_get_page(0);
+    if (pages == NULL)
+        return;
+    for (i = 0; i < HUGE_PGCNT; i++) {
+        pages[i] = spt_find_page(&cur->spt, base + i * PGSIZE);
+        if (!page_is_resident_huge(pages[i], page))
+            goto done;
+    }
+    run = vm_get_huge_run();
+    if (run == NULL)
+        goto done;
+
+    /* 복사하는 동안 clock이 가져가지 못하도록 기존 프레임을 고정 */
+    lock_acquire(&frame_lock);
+    for (pinned = 0; pinned < HUGE_PGCNT; pinned++) {
+        struct frame* f = pages[pinned]->frame;
+        if (f == NULL || f->pinned || f->ref_cnt != 1)
+            break;
+        f->pinned = true;
+    }
+    if (pinned < HUGE_PGCNT) {
+        while (pinned > 0)
+            unpin_frame(pages[--pinned]->frame);
+        lock_release(&frame_lock);
+        vm_free_huge_run(run);
+        goto done;
+    }
+    lock_release(&frame_lock);
+
+    for (i = 0; i < HUGE_PGCNT; i++)
+        memcpy(run[i].kva, pages[i]->frame->kva, PGSIZE);
+    if (!pml4_set_huge_page(cur->pml4, base, run->kva, page->writable)) {
+        for (i = 0; i < HUGE_PGCNT; i++)
+            vm_unpin_frame(pages[i]->frame);
+        vm_free_huge_run(run);
+        goto done;
+    }
+
+    lock_acquire(&frame_lock);
+    for (i = 0; i < HUGE_PGCNT; i++) {
+        struct frame* old = pages[i]->frame;
+        list_remove(&pages[i]->share_elem);
+        old->ref_cnt = 0;
+        old->page = NULL;
+        unpin_frame(old);
+        push_free_frame(old);
+        link_frame(&run[i], pages[i]);
+        unpin_frame(&run[i]);
+    }
+    lock_release(&frame_lock);
+
+done:
+    palloc_free_page(pages);
+}
+
+/* Tool for testing 2 MB pages. Calling this function via int 0x45.
+ * Input:
+ *   @RAX - Virtual address to inspect
+ * Output:
+ *   @RAX - 1 if it lies in a 2 MB page, 0 otherwise. */
+static void inspect_huge(struct intr_frame* f)
+{
+    const void* va = (const void*)f->R.rax;
+    f->R.rax = is_user_vaddr(va) && pml4_is_huge(thread_current()->pml4, va);
+}
+
+/* Tool for testing frame sharing. Calling this function via int 0x46.
+ * Output:
+ *   @RAX - Number of user pool frames in use. */
+static void inspect_frames(struct intr_frame* f)
+{
+    f->R.rax = frame_cnt - free_cnt;
+}
+
+/* Bring PAGE, which belongs to no thread (a page cache page), into a
+ * frame. The frame is left unpinned; see vm_pin_page(). */
+bool vm_claim_kernel_page(struct page* page)
+{
+    ASSERT(page->accessible_thread == NULL);
+    ASSERT(page->frame == NULL);
+    return vm_do_claim_page(page);
+}
+
+/* Pin PAGE's frame so that the clock leaves it alone while the kernel
+ * accesses it. Fails if PAGE is not resident or its frame is already
+ * pinned (being evicted, or in use by someone else). Undo with
+ * vm_unpin_frame(). */
+bool vm_pin_page(struct page* page)
+{
+    bool success = false;
+
+    lock_acquire(&frame_lock);
+    if (page->frame != NULL && !page->frame->pinned) {
+        page->frame->pinned = true;
+        success = true;
+    }
+    lock_release(&frame_lock);
+    return success;
+}
+
+/* Wait until PAGE's frame is unpinned, or PAGE has lost it to eviction.
+ * Returns false without waiting if PAGE is not resident or its frame is
+ * not pinned. PAGE must not be freed meanwhile; a caller that cannot
+ * guarantee that waits on the frame with vm_wait_frame() instead. */
+bool vm_wait_page(struct page* page)
+{
+    bool waited = false;
+
+    lock_acquire(&frame_lock);
+    while (page->frame != NULL && page->frame->pinned) {
+        cond_wait(&frame_cond, &frame_lock);
+        waited = true;
+    }
+    lock_release(&frame_lock);
+    return waited;
+}
+
+/* Wait until FRAME is unpinned. By then it may belong to another page. */
+void vm_wait_frame(struct frame* frame)
+{
+    lock_acquire(&frame_lock);
+    while (frame->pinned)
+        cond_wait(&frame_cond, &frame_lock);
+    lock_release(&frame_lock);
+}
 
+/* Map HOLDER's frame into PAGE's owner as well, with PAGE's own
+ * permissions. mmap uses this to map page cache pages. Fails if HOLDER
+ * is not resident or is being evicted; the caller claims it and retries. */
+bool vm_share_frame(struct page* holder, struct page* page)
+{
+    struct frame* frame;
+
+    /* PTE도 frame_lock 안에서 설정: 밖에서 하면 그 사이 clock이 rmap을 따라 매핑을
+     * 지운 뒤에 PTE가 생겨 해제된 프레임을 가리키게 됨 */
+    lock_acquire(&frame_lock);
+    frame = holder->frame;
+    if (frame == NULL || frame->page == NULL ||
+        !pml4_set_page(page->accessible_thread->pml4, page->va, frame->kva, page->writable)) {
+        lock_release(&frame_lock);
+        return false;
+    }
+    frame->ref_cnt++;
+    list_push_back(&frame->sharers, &page->share_elem);
+    page->frame = frame;
+    lock_release(&frame_lock);
     return true;
 }
 
+/* Link PAGE to FRAME, whose contents are already in place, and map it
+ * into the owner's address space. On failure FRAME is released. */
+bool vm_map_frame(struct page* page, struct frame* frame)
+{
+    struct thread* owner = page->accessible_thread;
+
+    link_frame(frame, page);
+    if (!pml4_set_page(owner->pml4, page->va, frame->kva, page->writable))
+        return rollback_claim(owner, page, false);
+    vm_unpin_frame(frame);
+    return true;
+}
+
+/* Bring in PAGE on FRAME, into which the caller has already put
+ * PAGE's contents, and map it if PAGE belongs to a thread. Neither
+ * swap_in nor, for an uninit PAGE, the init function is run; the
+ * caller drops its aux. On failure FRAME is freed and PAGE is left as
+ * it was. */
+bool vm_map_prefetched(struct page* page, struct frame* frame)
+{
+    struct thread* owner = page->accessible_thread;
+    struct uninit_page* uninit = &page->uninit;
+
+    if (owner != NULL && !pml4_set_page(owner->pml4, page->va, frame->kva, page->writable)) {
+        vm_free_frame(frame);
+        return false;
+    }
+    if (VM_TYPE(page->operations->type) == VM_UNINIT)
+        uninit->page_initializer(page, uninit->type, frame->kva);
+    lock_acquire(&frame_lock);
+    link_frame(frame, page);
+    unpin_frame(frame);
+    lock_release(&frame_lock);
+    return true;
+}
+
+/* Make PAGE the sole user of FRAME. */
+static void link_frame(struct frame* frame, struct page* page)
+{
+    frame->page = page;
+    frame->ref_cnt = 1;
+    list_push_back(&frame->sharers, &page->share_elem);
+    page->frame = frame;
+}
+
 static uint64_t page_hash(const struct hash_elem* hash_e, void* aux UNUSED)
 {
     struct page* page = hash_entry(hash_e, struct page, hash_elem);
@@ -346,6 +1114,7 @@ static bool page_less(const struct hash_elem* a, const struct hash_elem* b, void
 void supplemental_page_table_init(struct supplemental_page_table* spt)
 {
     hash_init(&spt->hash_table, page_hash, page_less, NULL);
+    rwlock_init(&spt->lock);
 }
 
 /* Copy supplemental page table from src to dst */
@@ -354,6 +1123,8 @@ bool supplemental_page_table_copy(struct supplemental_page_table* dst, struct su
     struct hash_iterator i;
     struct page* src_page;
 
+    /* SRC는 잠그지 않고 순회: 부모는 fork가 끝날 때까지 대기 중이라 SRC를 바꾸는
+     * 스레드가 없고, 복사 중 swap-in read-ahead가 SRC를 다시 읽기 때문 */
     hash_first(&i, &src->hash_table);
     while (hash_next(&i)) {
         src_page = hash_entry(hash_cur(&i), struct page, hash_elem);
@@ -364,17 +1135,28 @@ bool supplemental_page_table_copy(struct supplemental_page_table* dst, struct su
         if (page_get_type(src_page) == VM_FILE)
             continue;
 
+        if (src_type == VM_TEXT) {
+            /* 자식도 text cache를 거쳐 같은 프레임을 매핑 */
+            lazy_segment_get(src_page->text.seg);
+            if (!vm_alloc_page_with_initializer(VM_TEXT, upage, false, NULL, src_page->text.seg)) {
+                lazy_segment_put(src_page->text.seg);
+                return false;
+            }
+            continue;
+        }
+
         if (src_type == VM_UNINIT) {
             struct uninit_page* src_uninit = &src_page->uninit;
             if (VM_TYPE(src_uninit->type) == VM_FILE)
                 continue;
             if (src_uninit->aux != NULL) {
-                struct lazy_load_aux* copy_aux = malloc(sizeof(struct lazy_load_aux));
-                if (copy_aux == NULL)
-                    return false;
-                memcpy(copy_aux, src_uninit->aux, sizeof(struct lazy_load_aux));
-                if (!vm_alloc_page_with_initializer(src_uninit->type, upage, writable, src_uninit->init, copy_aux))
+                /* 실행 파일 segment는 복사하지 않고 자식과 공유 */
+                lazy_segment_get(src_uninit->aux);
+                if (!vm_alloc_page_with_initializer(src_uninit->type, upage, writable, src_uninit->init,
+                                                    src_uninit->aux)) {
+                    lazy_segment_put(src_uninit->aux);
                     return false;
+                }
             } else {
                 if (!vm_alloc_page(src_uninit->type, upage, writable))
                     return false;
@@ -383,52 +1165,142 @@ bool supplemental_page_table_copy(struct supplemental_page_table* dst, struct su
         }
         if (!vm_alloc_page(src_type, upage, writable))
             return false;
-        if (!vm_claim_page(upage))
+        if (!vm_share_page(src_page, spt_find_page(dst, upage)))
             return false;
-        struct page* dst_page = spt_find_page(dst, upage);
-        memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
     }
     return true;
 }
 
+/* Copy-on-write: map SRC's frame into DST as well, read-only in both
+ * address spaces. The first write to either side faults into
+ * vm_handle_wp(). A swapped-out SRC is brought back in first. */
+static bool vm_share_page(struct page* src, struct page* dst)
+{
+    struct frame* frame;
+
+    lock_acquire(&frame_lock);
+    while ((frame = src->frame) == NULL || frame->pinned) {
+        if (frame != NULL) {
+            /* 쫓겨나는 중: 끝나면 다시 읽어 옴 */
+            cond_wait(&frame_cond, &frame_lock);
+            continue;
+        }
+        lock_release(&frame_lock);
+        if (!vm_do_claim_page(src))
+            return false;
+        lock_acquire(&frame_lock);
+    }
+    frame->ref_cnt++;
+    list_push_back(&frame->sharers, &dst->share_elem);
+    dst->frame = frame;
+    lock_release(&frame_lock);
+
+    /* uninit -> anon 초기화만 수행, 프레임 내용은 건드리지 않음 */
+    if (!swap_in(dst, frame->kva))
+        return rollback_claim(dst->accessible_thread, dst, false);
+    if (!pml4_set_page(dst->accessible_thread->pml4, dst->va, frame->kva, false))
+        return rollback_claim(dst->accessible_thread, dst, false);
+    pml4_set_writable(src->accessible_thread->pml4, src->va, false);
+    return true;
+}
+
 /* Free the resource hold by the supplemental page table */
 void supplemental_page_table_kill(struct supplemental_page_table* spt)
 {
     /* TODO: Destroy all the supplemental_page_table hold by thread and
      * TODO: writeback all the modified contents to the storage. */
-    hash_clear(&spt->hash_table, hash_desroy_action);
+    struct list dead;
+
+    /* 표에서 떼어내는 것만 write lock 안에서: destroy는 파일 쓰기와 eviction을
+     * 거쳐 다시 spt_find_page()로 들어올 수 있음 */
+    list_init(&dead);
+    rwlock_acquire_write(&spt->lock);
+    spt->hash_table.aux = &dead;
+    hash_clear(&spt->hash_table, spt_detach_page);
+    spt->hash_table.aux = NULL;
+    rwlock_release_write(&spt->lock);
+
+    while (!list_empty(&dead))
+        hash_desroy_action(list_entry(list_pop_front(&dead), struct hash_elem, list_elem), NULL);
+}
+
+/* hash_clear() destructor: move the page onto the list DEAD_. */
+static void spt_detach_page(struct hash_elem* hash_elem, void* dead_)
+{
+    struct list* dead = dead_;
+    list_push_back(dead, &hash_elem->list_elem);
 }
 
 void hash_desroy_action(struct hash_elem* hash_elem, void* aux)
 {
     struct page* page = hash_entry(hash_elem, struct page, hash_elem);
     destroy(page);
-    free(page);
+    kmem_cache_free(page_slab, page);
 }
 
-static bool rollback_claim(struct thread* current, struct frame* frame, struct page* page, bool mapping_set)
+static bool rollback_claim(struct thread* owner, struct page* page, bool mapping_set)
 {
     if (mapping_set)
-        pml4_clear_page(current->pml4, page->va);
+        pml4_clear_page(owner->pml4, page->va);
+
+    vm_release_frame(page);
+    return false;
+}
 
+/* If PAGE is being swapped out by vm_evict_frame(), waits until that is
+ * over and PAGE has lost its frame. A page must not be destroyed while
+ * swap_out still works on it, so destroy functions call this before
+ * looking at PAGE's frame or swap slot. */
+void vm_wait_eviction(struct page* page)
+{
+    lock_acquire(&frame_lock);
+    while (page->frame != NULL && page->frame->evicting)
+        cond_wait(&frame_cond, &frame_lock);
+    lock_release(&frame_lock);
+}
+
+/* Drop PAGE's reference to its frame. The frame goes back to the
+ * free-frame stack once its last sharer is gone. The caller is
+ * responsible for clearing PAGE's mapping. A page that is being or has
+ * just been evicted keeps nothing to release, in which case nothing
+ * happens. */
+void vm_release_frame(struct page* page)
+{
+    struct frame* frame;
+
+    lock_acquire(&frame_lock);
+    /* 쫓겨나는 중인 페이지는 이미 프레임에서 떨어져 있음: 프레임은 evictor의 것 */
+    while ((frame = page->frame) != NULL && frame->evicting)
+        cond_wait(&frame_cond, &frame_lock);
+    if (frame == NULL) {
+        lock_release(&frame_lock);
+        return;
+    }
+    list_remove(&page->share_elem);
     page->frame = NULL;
+    if (--frame->ref_cnt > 0) {
+        /* vm_evict_shared()가 잡은 참조만 남으면 공유자 목록은 비어 있음 */
+        if (frame->page == page)
+            frame->page = list_empty(&frame->sharers) ? NULL
+                                                      : list_entry(list_front(&frame->sharers), struct page, share_elem);
+        lock_release(&frame_lock);
+        return;
+    }
     frame->page = NULL;
-
+    lock_release(&frame_lock);
     vm_free_frame(frame);
-    return false;
 }
+
+/* Return FRAME to the free-frame stack. */
 void vm_free_frame(struct frame* frame)
 {
     ASSERT(frame != NULL);
     ASSERT(frame->page == NULL);
+    ASSERT(list_empty(&frame->sharers));
 
-    if (frame->in_table) {
-        lock_acquire(&frame_lock);
-        list_remove(&frame->frame_elem);
-        lock_release(&frame_lock);
-        frame->in_table = false;
-    }
-
-    palloc_free_page(frame->kva);
-    free(frame);
+    /* 페이지는 palloc에 돌려주지 않고 free-frame stack에 보관 */
+    lock_acquire(&frame_lock);
+    unpin_frame(frame);
+    push_free_frame(frame);
+    lock_release(&frame_lock);
 }